@@ -0,0 +1,77 @@
+/*
+ * Table Print utilities
+ * Copyright (C) 2012-2013 Paul Ionkin <paul.ionkin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+// Time the list operations used by the tables: bench_linked_list [elements] [gotos]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "linked-list.h"
+
+
+static double now_ms (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int compare (const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+int main (int argc, char **argv)
+{
+    struct linked_list_t *list;
+    int count = argc > 1 ? atoi (argv[1]) : 1000000;
+    int gotos = argc > 2 ? atoi (argv[2]) : 2000;
+    int *keys;
+    double start;
+    int i;
+
+    keys = malloc (count * sizeof (int));
+    if (!keys)
+        return 1;
+    srand (1);
+    for (i = 0; i < count; i++)
+        keys[i] = rand () % 1000;
+
+    list = linked_list_create ();
+    start = now_ms ();
+    for (i = 0; i < count; i++)
+        linked_list_add (list, &keys[i]);
+    printf ("add %d elements: %.1f ms\n", count, now_ms () - start);
+
+    start = now_ms ();
+    for (i = 0; i < gotos; i++)
+        linked_list_goto (list, rand () % count);
+    printf ("%d random gotos: %.1f ms\n", gotos, now_ms () - start);
+
+    start = now_ms ();
+    linked_list_sort (list, compare);
+    printf ("sort: %.1f ms\n", now_ms () - start);
+
+    start = now_ms ();
+    linked_list_free (list);
+    printf ("free: %.1f ms\n", now_ms () - start);
+
+    free (keys);
+    return 0;
+}
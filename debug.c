@@ -1,5 +1,15 @@
 #include "debug.h"
 
+void warning(const char *fmt, ...){
+	va_list va;
+	va_start(va, fmt);
+	fprintf(stderr, "warning: ");
+	vfprintf(stderr, fmt, va);
+	fprintf(stderr, "\n");
+	va_end(va);
+}
+
+
 void fatal(const char *fmt, ...){
 	va_list va;
 	va_start(va, fmt);
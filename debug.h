@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
+void warning(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
 void fatal(const char *fmt, ...) __attribute__ ((noreturn, format (printf, 1, 2)));
 void panic(const char *fmt, ...) __attribute__ ((noreturn, format (printf, 1, 2)));
 
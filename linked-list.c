@@ -18,21 +18,96 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 //#include <mhandle.h>
 #include "debug.h"
 #include "linked-list.h"
 
 
+/* Elements in the first chunk of the pool. Later chunks double in size up to
+ * LINKED_LIST_CHUNK_MAX elements. */
+#define LINKED_LIST_CHUNK_MIN 16
+#define LINKED_LIST_CHUNK_MAX 1024
+
+
+/* Memory of a list goes through its allocator */
+static void *linked_list_alloc_default(size_t size, void *ctx)
+{
+	(void) ctx;
+	return malloc(size);
+}
+
+
+static void linked_list_release_default(void *ptr, void *ctx)
+{
+	(void) ctx;
+	free(ptr);
+}
+
+
+/* Take an element from the pool */
+static struct linked_list_elem_t *linked_list_elem_alloc(struct linked_list_t *list)
+{
+	struct linked_list_chunk_t *chunk = list->chunks;
+	struct linked_list_elem_t *elem;
+
+	/* Reuse a removed element */
+	if (list->free_elems)
+	{
+		elem = list->free_elems;
+		list->free_elems = elem->next;
+		return elem;
+	}
+
+	/* New chunk */
+	if (!chunk || chunk->used == chunk->size)
+	{
+		int size = chunk ? chunk->size * 2 : LINKED_LIST_CHUNK_MIN;
+
+		if (size > LINKED_LIST_CHUNK_MAX)
+			size = LINKED_LIST_CHUNK_MAX;
+		chunk = list->alloc(sizeof(struct linked_list_chunk_t) + size * sizeof(struct linked_list_elem_t), list->alloc_ctx);
+		if (!chunk)
+			fatal("%s: out of memory", __FUNCTION__);
+		chunk->used = 0;
+		chunk->size = size;
+		chunk->next = list->chunks;
+		list->chunks = chunk;
+	}
+
+	return &chunk->elems[chunk->used++];
+}
+
+
+/* Return an element to the pool */
+static void linked_list_elem_free(struct linked_list_t *list, struct linked_list_elem_t *elem)
+{
+	elem->next = list->free_elems;
+	list->free_elems = elem;
+}
+
+
 /* Creation */
 struct linked_list_t *linked_list_create()
+{
+	return linked_list_create_with_allocator(linked_list_alloc_default, linked_list_release_default, NULL);
+}
+
+
+struct linked_list_t *linked_list_create_with_allocator(void *(*alloc)(size_t size, void *ctx),
+	void (*release)(void *ptr, void *ctx), void *ctx)
 {
 	struct linked_list_t *list;
 
 	/* Create list */
-	list = calloc(1, sizeof(struct linked_list_t));
+	list = alloc(sizeof(struct linked_list_t), ctx);
 	if (!list)
 		fatal("%s: out of memory", __FUNCTION__);
+	memset(list, 0, sizeof(struct linked_list_t));
+	list->alloc = alloc;
+	list->release = release;
+	list->alloc_ctx = ctx;
 
 	/* Return */
 	return list;
@@ -43,7 +118,7 @@ struct linked_list_t *linked_list_create()
 void linked_list_free(struct linked_list_t *list)
 {
 	linked_list_clear(list);
-	free(list);
+	list->release(list, list->alloc_ctx);
 }
 
 
@@ -178,12 +253,36 @@ void linked_list_out(struct linked_list_t *list)
 
 void linked_list_goto(struct linked_list_t *list, int index)
 {
+	int distance;
+
 	if (index < 0 || index > list->count)
 	{
 		list->error_code = LINKED_LIST_ERR_BOUNDS;
 		return;
 	}
 	list->error_code = LINKED_LIST_ERR_OK;
+
+	/* Start from the head or the tail if they are closer */
+	distance = index - list->current_index;
+	if (distance < 0)
+		distance = -distance;
+	if (index == list->count)
+	{
+		list->current_index = index;
+		list->current = NULL;
+		return;
+	}
+	if (index < distance)
+	{
+		list->current_index = 0;
+		list->current = list->head;
+	}
+	else if (list->count - 1 - index < distance)
+	{
+		list->current_index = list->count - 1;
+		list->current = list->tail;
+	}
+
 	while (list->current_index < index)
 	{
 		list->current_index++;
@@ -232,9 +331,9 @@ void linked_list_insert(struct linked_list_t *list, void *data)
 	struct linked_list_elem_t *elem;
 	
 	/* Create a new element */
-	elem = calloc(1, sizeof(struct linked_list_elem_t));
-	if (!elem)
-		fatal("%s: out of memory", __FUNCTION__);
+	elem = linked_list_elem_alloc(list);
+	elem->prev = NULL;
+	elem->next = NULL;
 	elem->data = data;
 	
 	/* Insert it */
@@ -323,22 +422,22 @@ void linked_list_remove(struct linked_list_t *list)
 	list->error_code = LINKED_LIST_ERR_OK;
 	list->count--;
 	list->current = elem->next;
-	free(elem);
+	linked_list_elem_free(list, elem);
 }
 
 
 void linked_list_clear(struct linked_list_t *list)
 {
-	struct linked_list_elem_t *elem, *next;
+	struct linked_list_chunk_t *chunk, *next;
 	
 	/* Free all elements */
-	elem = list->head;
-	while (elem)
+	for (chunk = list->chunks; chunk; chunk = next)
 	{
-		next = elem->next;
-		free(elem);
-		elem = next;
+		next = chunk->next;
+		list->release(chunk, list->alloc_ctx);
 	}
+	list->chunks = NULL;
+	list->free_elems = NULL;
 	
 	/* Update list state */
 	list->error_code = LINKED_LIST_ERR_OK;
@@ -350,34 +449,60 @@ void linked_list_clear(struct linked_list_t *list)
 }
 
 
-static void sort(struct linked_list_elem_t **array, int lo, int hi, int (*comp)(const void *, const void *))
+/* Elements sorted by insertion before merging */
+#define LINKED_LIST_SORT_RUN 16
+
+
+/* Stable bottom-up merge sort of 'count' pointers in 'array', using 'tmp' as
+ * scratch space of the same size. Returns the buffer holding the result. */
+static void **sort(void **array, void **tmp, int count, int (*comp)(const void *, const void *))
 {
-	struct linked_list_elem_t *ptr, *tmp;
-	int i = lo, j = hi;
-	
-	ptr = array[(lo + hi) / 2];
-	do {
-		while (comp(array[i]->data, ptr->data) < 0)
-			i++;
-		while (comp(array[j]->data, ptr->data) > 0)
-			j--;
-		if (i <= j) {
-			tmp = array[i];
-			array[i] = array[j];
-			array[j] = tmp;
-			i++, j--;
+	void **src = array, **dst = tmp, **swap;
+	int size, lo, mid, hi, i, j, k;
+	void *data;
+
+	/* Short runs by insertion */
+	for (lo = 0; lo < count; lo += LINKED_LIST_SORT_RUN)
+	{
+		hi = lo + LINKED_LIST_SORT_RUN < count ? lo + LINKED_LIST_SORT_RUN : count;
+		for (i = lo + 1; i < hi; i++)
+		{
+			data = array[i];
+			for (j = i; j > lo && comp(array[j - 1], data) > 0; j--)
+				array[j] = array[j - 1];
+			array[j] = data;
+		}
+	}
+
+	/* Merge runs in pairs, taking from the left run on ties */
+	for (size = LINKED_LIST_SORT_RUN; size < count; size *= 2)
+	{
+		for (lo = 0; lo < count; lo += 2 * size)
+		{
+			mid = lo + size < count ? lo + size : count;
+			hi = lo + 2 * size < count ? lo + 2 * size : count;
+			i = lo;
+			j = mid;
+			k = lo;
+			while (i < mid && j < hi)
+				dst[k++] = comp(src[j], src[i]) < 0 ? src[j++] : src[i++];
+			while (i < mid)
+				dst[k++] = src[i++];
+			while (j < hi)
+				dst[k++] = src[j++];
 		}
-	} while (i <= j);
-	if (lo < j)
-		sort(array, lo, j, comp);
-	if (i < hi)
-		sort(array, i, hi, comp);
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	return src;
 }
 
 
 void linked_list_sort(struct linked_list_t *list, int (*comp)(const void *, const void *))
 {
-	struct linked_list_elem_t **array;
+	struct linked_list_elem_t *elem;
+	void **array, **sorted;
 	int i;
 	
 	/* No need to sort an empty list */
@@ -385,31 +510,16 @@ void linked_list_sort(struct linked_list_t *list, int (*comp)(const void *, cons
 	if (!list->count)
 		return;
 	
-	/* Create an array for elements */
-	array = calloc(list->count, sizeof(struct linked_list_elem_t *));
+	/* Sort the data of the elements, then store it back in list order */
+	array = list->alloc(2 * list->count * sizeof(void *), list->alloc_ctx);
 	if (!array)
 		fatal("%s: out of memory", __FUNCTION__);
-
-	/* Convert linked list into array */
-	list->current = list->head;
-	for (i = 0; i < list->count; i++)
-	{
-		array[i] = list->current;
-		list->current = list->current->next;
-	}
-	
-	/* Sort array */
-	sort(array, 0, list->count - 1, comp);
-	
-	/* Rebuild linked list */
-	list->head = array[0];
-	list->tail = array[list->count - 1];
-	for (i = 0; i < list->count; i++)
-	{
-		array[i]->prev = i > 0 ? array[i - 1] : NULL;
-		array[i]->next = i < list->count - 1 ? array[i + 1] : NULL;
-	}
-	free(array);
+	for (elem = list->head, i = 0; elem; elem = elem->next)
+		array[i++] = elem->data;
+	sorted = sort(array, array + list->count, list->count, comp);
+	for (elem = list->head, i = 0; elem; elem = elem->next)
+		elem->data = sorted[i++];
+	list->release(array, list->alloc_ctx);
 	
 	/* Set the first element as current element */
 	list->current_index = 0;
@@ -20,6 +20,8 @@
 #ifndef LINKED_LIST_H
 #define LINKED_LIST_H
 
+#include <stddef.h>
+
 
 /* Error constants */
 enum linked_list_error_t
@@ -40,6 +42,16 @@ struct linked_list_elem_t
 };
 
 
+/* Chunk of elements allocated at once */
+struct linked_list_chunk_t
+{
+	struct linked_list_chunk_t *next;
+	int used;
+	int size;
+	struct linked_list_elem_t elems[];
+};
+
+
 /* Linked list */
 struct linked_list_t
 {
@@ -50,6 +62,16 @@ struct linked_list_t
 	/* Private */
 	struct linked_list_elem_t *head, *tail, *current;
 	int current_index;
+
+	/* Element pool. Removed elements are kept in 'free_elems', linked by
+	 * their 'next' field, and reused by later insertions. */
+	struct linked_list_chunk_t *chunks;
+	struct linked_list_elem_t *free_elems;
+
+	/* Memory of the list, see linked_list_create_with_allocator */
+	void *(*alloc)(size_t size, void *ctx);
+	void (*release)(void *ptr, void *ctx);
+	void *alloc_ctx;
 };
 
 
@@ -71,6 +93,23 @@ struct linked_list_t
 struct linked_list_t *linked_list_create(void);
 
 
+/** Create a linked list whose memory, including the list object, is
+ * allocated with 'alloc' and released with 'release'.
+ *
+ * @param alloc
+ * 	Returns 'size' bytes, or NULL if out of memory.
+ * @param release
+ * 	Releases memory returned by 'alloc'.
+ * @param ctx
+ * 	Last argument of both functions.
+ *
+ * @return
+ * 	Linked list object.
+ */
+struct linked_list_t *linked_list_create_with_allocator(void *(*alloc)(size_t size, void *ctx),
+	void (*release)(void *ptr, void *ctx), void *ctx);
+
+
 /* Free linked list.
  *
  * @param list
@@ -222,7 +261,8 @@ void linked_list_tail(struct linked_list_t *list);
 void linked_list_out(struct linked_list_t *list);
 
 
-/** Set the current element to a given position.
+/** Set the current element to a given position. The list is walked from the
+ * closest of the head, the tail and the current element.
  *
  * @param list
  * 	List object.
@@ -331,7 +371,7 @@ void linked_list_add(struct linked_list_t *list, void *data);
 void linked_list_remove(struct linked_list_t *list);
 
 
-/** Empty the list.
+/** Empty the list, releasing the memory of its elements.
  *
  * @param list
  * 	List object.
@@ -342,7 +382,8 @@ void linked_list_remove(struct linked_list_t *list);
 void linked_list_clear(struct linked_list_t *list);
 
 
-/** Sort the list.
+/** Sort the list. The sort is stable: elements that compare equal keep their
+ * relative order. After sorting, the current element is the head.
  *
  * @param list
  * 	List object.
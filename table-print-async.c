@@ -0,0 +1,198 @@
+/*
+ * Table Print utilities
+ * Copyright (C) 2012-2013 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2013 Vicent Selfa <vtselfa@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "debug.h"
+#include "linked-list.h"
+#include "table-print.h"
+
+
+/* Table waiting to be printed by the writer thread */
+struct table_print_job_t
+{
+	struct table_print_t *tp;
+	table_print_done_func_t done;
+	void *data;
+	struct table_print_allocator_t allocator; // of the table, which 'done' may free
+};
+
+
+/* A single writer thread prints the tables in the order they were
+ * submitted, so tables sent to the same FILE do not interleave. */
+static pthread_once_t table_print_async_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t table_print_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t table_print_async_job = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t table_print_async_idle = PTHREAD_COND_INITIALIZER;
+static struct linked_list_t *table_print_async_jobs;
+static int table_print_async_busy;
+
+
+static void *table_print_async_writer(void *arg)
+{
+	struct table_print_job_t *job;
+
+	(void) arg;
+	for (;;)
+	{
+		pthread_mutex_lock(&table_print_async_lock);
+		while (!linked_list_count(table_print_async_jobs))
+			pthread_cond_wait(&table_print_async_job, &table_print_async_lock);
+		linked_list_head(table_print_async_jobs);
+		job = linked_list_get(table_print_async_jobs);
+		linked_list_remove(table_print_async_jobs);
+		table_print_async_busy = TRUE;
+		pthread_mutex_unlock(&table_print_async_lock);
+
+		table_print_print(job->tp);
+		fflush(table_print_get_fout(job->tp));
+		if (job->done)
+			job->done(job->tp, job->data);
+		else
+			table_print_free(job->tp);
+		table_print_mem_free(&job->allocator, job);
+
+		pthread_mutex_lock(&table_print_async_lock);
+		table_print_async_busy = FALSE;
+		if (!linked_list_count(table_print_async_jobs))
+			pthread_cond_broadcast(&table_print_async_idle);
+		pthread_mutex_unlock(&table_print_async_lock);
+	}
+	return NULL;
+}
+
+
+static void table_print_async_init(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+
+	table_print_async_jobs = linked_list_create();
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, table_print_async_writer, NULL))
+		fatal("%s: cannot create writer thread", __FUNCTION__);
+	pthread_attr_destroy(&attr);
+}
+
+
+void table_print_print_async(struct table_print_t *tp, table_print_done_func_t done, void *data)
+{
+	struct table_print_job_t *job;
+
+	pthread_once(&table_print_async_once, table_print_async_init);
+
+	job = table_print_mem_calloc(table_print_get_allocator(tp), 1, sizeof(struct table_print_job_t));
+	if (!job)
+		fatal("%s: out of memory", __FUNCTION__);
+	job->allocator = *table_print_get_allocator(tp);
+	job->tp = tp;
+	job->done = done;
+	job->data = data;
+
+	pthread_mutex_lock(&table_print_async_lock);
+	linked_list_add(table_print_async_jobs, job);
+	pthread_cond_signal(&table_print_async_job);
+	pthread_mutex_unlock(&table_print_async_lock);
+}
+
+
+void table_print_async_wait(void)
+{
+	pthread_once(&table_print_async_once, table_print_async_init);
+
+	pthread_mutex_lock(&table_print_async_lock);
+	while (linked_list_count(table_print_async_jobs) || table_print_async_busy)
+		pthread_cond_wait(&table_print_async_idle, &table_print_async_lock);
+	pthread_mutex_unlock(&table_print_async_lock);
+}
+
+
+/*
+ * Double buffered snapshots
+ */
+
+struct table_print_snapshot_t
+{
+	pthread_mutex_t lock; // held by producers while writing a row
+	struct table_print_t *active; // written by producers
+	struct table_print_t *standby; // empty, or rows being moved to 'view'
+	struct table_print_t *view; // every row completed so far, only touched by the printer
+	struct table_print_allocator_t allocator; // of the tables
+};
+
+
+struct table_print_snapshot_t *table_print_snapshot_create(struct table_print_t *tp)
+{
+	struct table_print_snapshot_t *snap;
+
+	snap = table_print_mem_calloc(table_print_get_allocator(tp), 1, sizeof(struct table_print_snapshot_t));
+	if (!snap)
+		fatal("%s: out of memory", __FUNCTION__);
+	snap->allocator = *table_print_get_allocator(tp);
+	pthread_mutex_init(&snap->lock, NULL);
+	snap->active = tp;
+	snap->standby = table_print_create_like(tp);
+	snap->view = table_print_create_like(tp);
+
+	return snap;
+}
+
+
+void table_print_snapshot_free(struct table_print_snapshot_t *snap)
+{
+	table_print_free(snap->active);
+	table_print_free(snap->standby);
+	table_print_free(snap->view);
+	pthread_mutex_destroy(&snap->lock);
+	table_print_mem_free(&snap->allocator, snap);
+}
+
+
+struct table_print_t *table_print_snapshot_begin_row(struct table_print_snapshot_t *snap)
+{
+	pthread_mutex_lock(&snap->lock);
+	return snap->active;
+}
+
+
+void table_print_snapshot_end_row(struct table_print_snapshot_t *snap)
+{
+	pthread_mutex_unlock(&snap->lock);
+}
+
+
+void table_print_snapshot_print(struct table_print_snapshot_t *snap)
+{
+	struct table_print_t *done;
+
+	/* Producers only wait for the swap, which happens between rows */
+	pthread_mutex_lock(&snap->lock);
+	done = snap->active;
+	snap->active = snap->standby;
+	snap->standby = done;
+	pthread_mutex_unlock(&snap->lock);
+
+	/* Nobody else touches the retired buffer now. Its blocks are moved to
+	 * the view, which leaves it empty for the next swap. */
+	table_print_merge(snap->view, done);
+	table_print_print(snap->view);
+}
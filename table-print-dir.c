@@ -0,0 +1,402 @@
+/*
+ * Table Print utilities
+ * Copyright (C) 2012-2013 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2013 Vicent Selfa <vtselfa@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "table-print.h"
+
+
+/*
+ * Directory scans
+ *
+ * The names are read first, then sorted, then looked up by a pool of
+ * threads that take TABLE_PRINT_DIR_CHUNK entries at a time. Rows are added
+ * by the calling thread once every entry has been looked up, as tables are
+ * not thread safe.
+ */
+
+#define TABLE_PRINT_DIR_CHUNK 32
+
+/* Without statx the mask only tells whether entries are looked up */
+#ifndef STATX_BASIC_STATS
+#define STATX_TYPE 0x1
+#define STATX_MODE 0x2
+#define STATX_UID 0x8
+#define STATX_GID 0x10
+#define STATX_MTIME 0x40
+#define STATX_SIZE 0x200
+#endif
+
+
+struct table_print_dir_entry_t
+{
+	const char *name;
+	size_t offset; // of the name in the buffer, which moves while it is read
+	int len;
+	int ok; // looked up, FALSE if it was removed in the meantime
+
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	unsigned long long size;
+	long long mtime;
+	int mtime_ns;
+};
+
+
+struct table_print_dir_scan_t
+{
+	int fd; // of the directory
+	int use_statx;
+	unsigned int mask; // STATX_* fields needed
+
+	struct table_print_dir_entry_t *entries;
+	int count;
+	const struct table_print_allocator_t *allocator; // of the table
+
+	pthread_mutex_t lock;
+	int next; // first entry not taken by a worker
+};
+
+
+/* Look 'entry' up, without following symbolic links */
+static void table_print_dir_stat(struct table_print_dir_scan_t *scan, struct table_print_dir_entry_t *entry)
+{
+	struct stat st;
+
+#ifdef STATX_BASIC_STATS
+	struct statx stx;
+
+	/* Only the fields that are needed, which saves work on network file
+	 * systems. Some may not provide all of them. */
+	if (scan->use_statx &&
+			!statx(scan->fd, entry->name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, scan->mask, &stx) &&
+			(stx.stx_mask & scan->mask) == scan->mask)
+	{
+		entry->mode = stx.stx_mode;
+		entry->uid = stx.stx_uid;
+		entry->gid = stx.stx_gid;
+		entry->size = stx.stx_size;
+		entry->mtime = stx.stx_mtime.tv_sec;
+		entry->mtime_ns = stx.stx_mtime.tv_nsec;
+		entry->ok = TRUE;
+		return;
+	}
+#endif
+
+	if (fstatat(scan->fd, entry->name, &st, AT_SYMLINK_NOFOLLOW))
+		return;
+	entry->mode = st.st_mode;
+	entry->uid = st.st_uid;
+	entry->gid = st.st_gid;
+	entry->size = st.st_size;
+	entry->mtime = st.st_mtim.tv_sec;
+	entry->mtime_ns = st.st_mtim.tv_nsec;
+	entry->ok = TRUE;
+}
+
+
+static void *table_print_dir_worker(void *arg)
+{
+	struct table_print_dir_scan_t *scan = arg;
+
+	for (;;)
+	{
+		int first;
+		int last;
+
+		pthread_mutex_lock(&scan->lock);
+		first = scan->next;
+		scan->next += TABLE_PRINT_DIR_CHUNK;
+		pthread_mutex_unlock(&scan->lock);
+
+		if (first >= scan->count)
+			break;
+		last = first + TABLE_PRINT_DIR_CHUNK < scan->count ? first + TABLE_PRINT_DIR_CHUNK : scan->count;
+		for (; first < last; first++)
+			table_print_dir_stat(scan, &scan->entries[first]);
+	}
+	return NULL;
+}
+
+
+static int table_print_dir_compare(const void *a, const void *b)
+{
+	const struct table_print_dir_entry_t *x = a;
+	const struct table_print_dir_entry_t *y = b;
+
+	return strcmp(x->name, y->name);
+}
+
+
+/* Type and permissions, as printed by ls -l */
+static void table_print_dir_format_mode(mode_t mode, char *out)
+{
+	const char *rwx = "rwxrwxrwx";
+	int i;
+
+	if (S_ISDIR(mode))
+		out[0] = 'd';
+	else if (S_ISLNK(mode))
+		out[0] = 'l';
+	else if (S_ISCHR(mode))
+		out[0] = 'c';
+	else if (S_ISBLK(mode))
+		out[0] = 'b';
+	else if (S_ISFIFO(mode))
+		out[0] = 'p';
+	else if (S_ISSOCK(mode))
+		out[0] = 's';
+	else
+		out[0] = '-';
+	for (i = 0; i < 9; i++)
+		out[i + 1] = mode & (0400 >> i) ? rwx[i] : '-';
+	out[10] = '\0';
+}
+
+
+/* Buffer of the names of the entries, released with the rows */
+struct table_print_dir_names_t
+{
+	struct table_print_allocator_t allocator; // of the table
+	char data[];
+};
+
+
+static void table_print_dir_names_free(void *data)
+{
+	struct table_print_dir_names_t *names = data;
+	struct table_print_allocator_t allocator = names->allocator;
+
+	table_print_mem_free(&allocator, names);
+}
+
+
+/* Read the names of the directory into 'scan'. They are kept in a single
+ * buffer, returned, that the table releases. */
+static struct table_print_dir_names_t *table_print_dir_read(struct table_print_dir_scan_t *scan)
+{
+	struct table_print_dir_names_t *names;
+	struct dirent *ent;
+	size_t names_len = 0;
+	size_t names_size = 4096;
+	int size = 0;
+	int fd;
+	DIR *dir;
+	int i;
+
+	fd = dup(scan->fd);
+	if (fd < 0)
+		return NULL;
+	dir = fdopendir(fd);
+	if (!dir)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	names = table_print_mem_malloc(scan->allocator, sizeof(struct table_print_dir_names_t) + names_size);
+	if (!names)
+		fatal("%s: out of memory", __FUNCTION__);
+	names->allocator = *scan->allocator;
+	errno = 0;
+	while ((ent = readdir(dir)))
+	{
+		int len = strlen(ent->d_name);
+
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+		if (names_len + len + 1 > names_size)
+		{
+			names_size = (names_len + len + 1) * 2;
+			names = table_print_mem_realloc(scan->allocator, names, sizeof(struct table_print_dir_names_t) + names_size);
+			if (!names)
+				fatal("%s: out of memory", __FUNCTION__);
+		}
+		if (scan->count == size)
+		{
+			size = size ? size * 2 : 256;
+			scan->entries = table_print_mem_realloc(scan->allocator, scan->entries,
+					size * sizeof(struct table_print_dir_entry_t));
+			if (!scan->entries)
+				fatal("%s: out of memory", __FUNCTION__);
+		}
+
+		/* Offsets until the buffer stops moving */
+		memset(&scan->entries[scan->count], 0, sizeof(struct table_print_dir_entry_t));
+		scan->entries[scan->count].offset = names_len;
+		scan->entries[scan->count].len = len;
+		scan->count++;
+		memcpy(names->data + names_len, ent->d_name, len + 1);
+		names_len += len + 1;
+	}
+	if (errno)
+	{
+		closedir(dir);
+		table_print_mem_free(scan->allocator, names);
+		return NULL;
+	}
+	closedir(dir);
+
+	for (i = 0; i < scan->count; i++)
+		scan->entries[i].name = names->data + scan->entries[i].offset;
+	return names;
+}
+
+
+int table_print_from_directory(struct table_print_t *tp, const char *path,
+		const enum table_print_dir_field_t *fields, int num_fields, int workers)
+{
+	struct table_print_dir_names_t *names;
+	struct table_print_dir_scan_t scan;
+	pthread_t *threads;
+	int rows = 0;
+	int i;
+
+	if (num_fields != table_print_get_num_columns(tp))
+		fatal("%s: %d fields for %d columns", __FUNCTION__, num_fields, table_print_get_num_columns(tp));
+
+	memset(&scan, 0, sizeof(scan));
+	scan.allocator = table_print_get_allocator(tp);
+	for (i = 0; i < num_fields; i++)
+	{
+		switch (fields[i])
+		{
+		case table_print_dir_name:
+			break;
+		case table_print_dir_mode:
+			scan.mask |= STATX_TYPE | STATX_MODE;
+			break;
+		case table_print_dir_uid:
+			scan.mask |= STATX_UID;
+			break;
+		case table_print_dir_gid:
+			scan.mask |= STATX_GID;
+			break;
+		case table_print_dir_size:
+			scan.mask |= STATX_SIZE;
+			break;
+		case table_print_dir_mtime:
+		case table_print_dir_mtime_ns:
+			scan.mask |= STATX_MTIME;
+			break;
+		default:
+			fatal("%s: unknown field %d", __FUNCTION__, fields[i]);
+		}
+	}
+
+	scan.fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (scan.fd < 0)
+		return -1;
+	names = table_print_dir_read(&scan);
+	if (!names)
+	{
+		int err = errno;
+
+		table_print_mem_free(scan.allocator, scan.entries);
+		close(scan.fd);
+		errno = err;
+		return -1;
+	}
+	qsort(scan.entries, scan.count, sizeof(struct table_print_dir_entry_t), table_print_dir_compare);
+
+	/* Names alone need no lookups */
+	if (scan.mask)
+	{
+#ifdef STATX_BASIC_STATS
+		struct statx stx;
+
+		scan.use_statx = !statx(scan.fd, "", AT_EMPTY_PATH, STATX_TYPE, &stx) || errno != ENOSYS;
+#endif
+		if (workers <= 0)
+			workers = sysconf(_SC_NPROCESSORS_ONLN);
+		if (workers > (scan.count + TABLE_PRINT_DIR_CHUNK - 1) / TABLE_PRINT_DIR_CHUNK)
+			workers = (scan.count + TABLE_PRINT_DIR_CHUNK - 1) / TABLE_PRINT_DIR_CHUNK;
+
+		/* The calling thread is one of the workers */
+		pthread_mutex_init(&scan.lock, NULL);
+		threads = table_print_mem_calloc(scan.allocator, workers + 1, sizeof(pthread_t));
+		if (!threads)
+			fatal("%s: out of memory", __FUNCTION__);
+		for (i = 1; i < workers; i++)
+			if (pthread_create(&threads[i], NULL, table_print_dir_worker, &scan))
+				fatal("%s: cannot create worker thread", __FUNCTION__);
+		table_print_dir_worker(&scan);
+		for (i = 1; i < workers; i++)
+			pthread_join(threads[i], NULL);
+		table_print_mem_free(scan.allocator, threads);
+		pthread_mutex_destroy(&scan.lock);
+	}
+	close(scan.fd);
+
+	/* Names are borrowed from the buffer, which lives as long as the rows */
+	for (i = 0; i < scan.count; i++)
+	{
+		struct table_print_dir_entry_t *entry = &scan.entries[i];
+		int k;
+
+		if (scan.mask && !entry->ok)
+			continue;
+		for (k = 0; k < num_fields; k++)
+		{
+			char mode[11];
+
+			switch (fields[k])
+			{
+			case table_print_dir_name:
+				table_print_data_add_str_ref(tp, k, entry->name, entry->len);
+				break;
+			case table_print_dir_mode:
+				table_print_dir_format_mode(entry->mode, mode);
+				table_print_data_add_str(tp, k, mode);
+				break;
+			case table_print_dir_uid:
+				table_print_data_add_uint64(tp, k, entry->uid);
+				break;
+			case table_print_dir_gid:
+				table_print_data_add_uint64(tp, k, entry->gid);
+				break;
+			case table_print_dir_size:
+				table_print_data_add_uint64(tp, k, entry->size);
+				break;
+			case table_print_dir_mtime:
+				table_print_data_add_uint64(tp, k, entry->mtime);
+				break;
+			default:
+				table_print_data_add_uint64(tp, k, entry->mtime * 1000000000ULL + entry->mtime_ns);
+				break;
+			}
+		}
+		rows++;
+	}
+	table_print_add_release(tp, table_print_dir_names_free, names);
+	table_print_mem_free(scan.allocator, scan.entries);
+
+	return rows;
+}
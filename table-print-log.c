@@ -0,0 +1,389 @@
+/*
+ * Table Print utilities
+ * Copyright (C) 2012-2013 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2013 Vicent Selfa <vtselfa@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "table-print.h"
+
+
+/*
+ * Row log
+ *
+ * File layout, in native byte order:
+ *   magic, byte order mark, version
+ *   schema of the table (see table_print_schema_write)
+ *   number of fields, then type, size and offset of each field
+ *   record size
+ *   records, back to back
+ */
+
+#define TABLE_PRINT_LOG_MAGIC "TPRNTLOG"
+#define TABLE_PRINT_LOG_BOM 0x01020304
+#define TABLE_PRINT_LOG_VERSION 2
+
+/* Records are collected here before being written */
+#define TABLE_PRINT_LOG_BUFFER (64 * 1024)
+
+
+struct table_print_log_t
+{
+	FILE *f;
+	int num_fields;
+	int record_size;
+
+	char *buf;
+	int buf_len;
+	int buf_size;
+
+	struct table_print_allocator_t allocator; // of the table, which may be freed first
+};
+
+
+/* Size and alignment of a field */
+static int table_print_log_field_size(const struct table_print_field_t *field)
+{
+	switch (field->type)
+	{
+	case table_print_type_int32:
+		return sizeof(int);
+	case table_print_type_uint64:
+		return sizeof(unsigned long long);
+	case table_print_type_double:
+		return sizeof(double);
+	default:
+		return field->size;
+	}
+}
+
+
+static int table_print_log_field_align(const struct table_print_field_t *field)
+{
+	return field->type == table_print_type_str ? 1 : table_print_log_field_size(field);
+}
+
+
+/* Whether column 'col' takes values of 'type'. Delta encoded columns, time
+ * columns included, only take integers. */
+static int table_print_log_field_fits(struct table_print_t *tp, int col, enum table_print_type_t type)
+{
+	return table_print_get_column_encoding(tp, col) != table_print_encoding_delta ||
+			type == table_print_type_int32 || type == table_print_type_uint64;
+}
+
+
+/* Offset of every field in a record laid out like a C struct. Returns the
+ * record size. */
+static int table_print_log_layout(const struct table_print_field_t *fields, int num_fields, int *offsets)
+{
+	int offset = 0;
+	int max_align = 1;
+	int i;
+
+	for (i = 0; i < num_fields; i++)
+	{
+		int align = table_print_log_field_align(&fields[i]);
+
+		offset = (offset + align - 1) / align * align;
+		offsets[i] = offset;
+		offset += table_print_log_field_size(&fields[i]);
+		if (align > max_align)
+			max_align = align;
+	}
+	return (offset + max_align - 1) / max_align * max_align;
+}
+
+
+struct table_print_log_t *table_print_log_create(FILE *f, struct table_print_t *tp,
+		const struct table_print_field_t *fields, int num_fields)
+{
+	const struct table_print_allocator_t *allocator;
+	struct table_print_log_t *log;
+	int *offsets;
+	int i;
+
+	if (num_fields != table_print_get_num_columns(tp))
+		fatal("%s: %d fields for %d columns", __FUNCTION__, num_fields, table_print_get_num_columns(tp));
+	for (i = 0; i < num_fields; i++)
+	{
+		if (fields[i].type < table_print_type_int32 || fields[i].type > table_print_type_str)
+			fatal("%s: field %d has an unknown type", __FUNCTION__, i);
+		if (fields[i].type == table_print_type_str && fields[i].size <= 0)
+			fatal("%s: string field %d has no size", __FUNCTION__, i);
+		/* Checked now rather than when the log is replayed */
+		if (!table_print_log_field_fits(tp, i, fields[i].type))
+			fatal("%s: column %d is delta encoded and field %d is not an integer", __FUNCTION__, i, i);
+	}
+
+	allocator = table_print_get_allocator(tp);
+	log = table_print_mem_calloc(allocator, 1, sizeof(struct table_print_log_t));
+	offsets = table_print_mem_calloc(allocator, num_fields + 1, sizeof(int));
+	if (!log || !offsets)
+		fatal("%s: out of memory", __FUNCTION__);
+	log->allocator = *allocator;
+	log->f = f;
+	log->num_fields = num_fields;
+	log->record_size = table_print_log_layout(fields, num_fields, offsets);
+	log->buf_size = log->record_size > TABLE_PRINT_LOG_BUFFER ? log->record_size : TABLE_PRINT_LOG_BUFFER;
+	log->buf = table_print_mem_malloc(allocator, log->buf_size);
+	if (!log->buf)
+		fatal("%s: out of memory", __FUNCTION__);
+
+	/* Header */
+	fwrite(TABLE_PRINT_LOG_MAGIC, 1, 8, f);
+	i = TABLE_PRINT_LOG_BOM;
+	fwrite(&i, sizeof(int), 1, f);
+	i = TABLE_PRINT_LOG_VERSION;
+	fwrite(&i, sizeof(int), 1, f);
+	table_print_schema_write(tp, f);
+	fwrite(&num_fields, sizeof(int), 1, f);
+	for (i = 0; i < num_fields; i++)
+	{
+		int size = table_print_log_field_size(&fields[i]);
+
+		fwrite(&fields[i].type, sizeof(int), 1, f);
+		fwrite(&size, sizeof(int), 1, f);
+		fwrite(&offsets[i], sizeof(int), 1, f);
+	}
+	fwrite(&log->record_size, sizeof(int), 1, f);
+	if (ferror(f))
+		fatal("%s: cannot write log", __FUNCTION__);
+
+	table_print_mem_free(allocator, offsets);
+	return log;
+}
+
+
+void table_print_log_flush(struct table_print_log_t *log)
+{
+	if (log->buf_len && fwrite(log->buf, 1, log->buf_len, log->f) != (size_t) log->buf_len)
+		fatal("%s: cannot write log", __FUNCTION__);
+	log->buf_len = 0;
+	fflush(log->f);
+}
+
+
+void table_print_log_free(struct table_print_log_t *log)
+{
+	struct table_print_allocator_t allocator = log->allocator;
+
+	table_print_log_flush(log);
+	table_print_mem_free(&allocator, log->buf);
+	table_print_mem_free(&allocator, log);
+}
+
+
+void table_print_log_append(struct table_print_log_t *log, const void *record)
+{
+	if (log->buf_len + log->record_size > log->buf_size)
+	{
+		if (fwrite(log->buf, 1, log->buf_len, log->f) != (size_t) log->buf_len)
+			fatal("%s: cannot write log", __FUNCTION__);
+		log->buf_len = 0;
+	}
+	memcpy(log->buf + log->buf_len, record, log->record_size);
+	log->buf_len += log->record_size;
+}
+
+
+int table_print_log_record_size(struct table_print_log_t *log)
+{
+	return log->record_size;
+}
+
+
+/*
+ * Replay
+ */
+
+/* Field as read back from a log */
+struct table_print_log_field_t
+{
+	enum table_print_type_t type;
+	int size;
+	int offset;
+};
+
+
+/* Whether a field read back from a log is a known type that lies inside
+ * records of 'record_size' bytes */
+static int table_print_log_field_valid(const struct table_print_log_field_t *field, int record_size)
+{
+	switch (field->type)
+	{
+	case table_print_type_int32:
+		if (field->size != sizeof(int))
+			return FALSE;
+		break;
+	case table_print_type_uint64:
+		if (field->size != sizeof(unsigned long long))
+			return FALSE;
+		break;
+	case table_print_type_double:
+		if (field->size != sizeof(double))
+			return FALSE;
+		break;
+	case table_print_type_str:
+		break;
+	default:
+		return FALSE;
+	}
+	return field->size > 0 && field->offset >= 0 && field->offset <= record_size - field->size;
+}
+
+
+static void table_print_log_add_field(struct table_print_t *tp, int col, struct table_print_log_field_t *field,
+		const char *record)
+{
+	const char *data = record + field->offset;
+	unsigned long long u64;
+	double d;
+	int i32;
+	int len;
+
+	switch (field->type)
+	{
+	case table_print_type_int32:
+		memcpy(&i32, data, sizeof(int));
+		table_print_data_add_int32(tp, col, i32);
+		break;
+	case table_print_type_uint64:
+		memcpy(&u64, data, sizeof(unsigned long long));
+		table_print_data_add_uint64(tp, col, u64);
+		break;
+	case table_print_type_double:
+		memcpy(&d, data, sizeof(double));
+		table_print_data_add_double(tp, col, d);
+		break;
+	default:
+		/* Null terminated unless it fills the field */
+		for (len = 0; len < field->size && data[len]; len++)
+			;
+		table_print_data_add_str_ref(tp, col, data, len);
+		break;
+	}
+}
+
+
+/* Read the whole log into a new table that prints to 'fout'. Returns NULL if
+ * 'f' does not hold a log. */
+struct table_print_t *table_print_log_read(FILE *f, FILE *fout)
+{
+	struct table_print_log_field_t *fields;
+	struct table_print_t *tp;
+	char magic[8];
+	int header[2];
+	int num_fields;
+	int record_size;
+	char *records;
+	size_t size;
+	size_t len;
+	int i;
+
+	if (fread(magic, 1, 8, f) != 8 || memcmp(magic, TABLE_PRINT_LOG_MAGIC, 8))
+	{
+		warning("%s: not a table log", __FUNCTION__);
+		return NULL;
+	}
+	if (fread(header, sizeof(int), 2, f) != 2 || header[0] != TABLE_PRINT_LOG_BOM ||
+			header[1] != TABLE_PRINT_LOG_VERSION)
+	{
+		warning("%s: unsupported table log (byte order or version)", __FUNCTION__);
+		return NULL;
+	}
+
+	tp = table_print_schema_read(f, fout);
+	if (!tp)
+	{
+		warning("%s: truncated table log", __FUNCTION__);
+		return NULL;
+	}
+
+	if (fread(&num_fields, sizeof(int), 1, f) != 1 || num_fields < 0)
+	{
+		warning("%s: truncated table log", __FUNCTION__);
+		table_print_free(tp);
+		return NULL;
+	}
+	fields = calloc(num_fields + 1, sizeof(struct table_print_log_field_t));
+	if (!fields)
+		fatal("%s: out of memory", __FUNCTION__);
+	for (i = 0; i < num_fields; i++)
+	{
+		int values[3];
+
+		if (fread(values, sizeof(int), 3, f) != 3)
+		{
+			warning("%s: truncated table log", __FUNCTION__);
+			free(fields);
+			table_print_free(tp);
+			return NULL;
+		}
+		fields[i].type = values[0];
+		fields[i].size = values[1];
+		fields[i].offset = values[2];
+	}
+	if (fread(&record_size, sizeof(int), 1, f) != 1 || record_size <= 0)
+	{
+		warning("%s: truncated table log", __FUNCTION__);
+		free(fields);
+		table_print_free(tp);
+		return NULL;
+	}
+	for (i = 0; i < num_fields; i++)
+	{
+		if (!table_print_log_field_valid(&fields[i], record_size) ||
+				(i < table_print_get_num_columns(tp) && !table_print_log_field_fits(tp, i, fields[i].type)))
+		{
+			warning("%s: corrupt table log (field %d)", __FUNCTION__, i);
+			free(fields);
+			table_print_free(tp);
+			return NULL;
+		}
+	}
+
+	/* Records are read a buffer at a time. String cells refer to the buffer,
+	 * so each buffer lives as long as the table. */
+	if (num_fields > table_print_get_num_columns(tp))
+		num_fields = table_print_get_num_columns(tp);
+	size = (TABLE_PRINT_LOG_BUFFER / record_size + 1) * record_size;
+	do
+	{
+		size_t j;
+
+		records = malloc(size);
+		if (!records)
+			fatal("%s: out of memory", __FUNCTION__);
+		len = fread(records, 1, size, f);
+		for (j = 0; j + record_size <= len; j += record_size)
+			for (i = 0; i < num_fields; i++)
+				table_print_log_add_field(tp, i, &fields[i], records + j);
+		table_print_add_release(tp, free, records);
+	} while (len == size);
+
+	/* A writer that did not finish can leave part of a record */
+	if (ferror(f))
+		warning("%s: error reading table log", __FUNCTION__);
+	else if (len % record_size)
+		warning("%s: last record is incomplete", __FUNCTION__);
+	free(fields);
+
+	return tp;
+}
@@ -17,403 +17,5336 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "debug.h"
 #include "linked-list.h"
 #include "table-print.h"
 
 
 struct table_print_t
 {
+	struct table_print_allocator_t allocator; // memory of the table
 	FILE *fout;
-	struct list_t *columns;
+	struct linked_list_t *columns;
 	int rows;
 
 	int spaces_left;
 	int spaces_between;
 	int show_borders;
 	int show_header;
-	int min_column_width;
+
+	char *double_fmt;
+	char *int32_fmt;
+
+	int width_limit; // for columns without their own limit, 0 if unlimited
+	enum table_print_overflow_t overflow;
+
+	struct table_print_plan_t *plan; // cached by table_print_print
+
+	int changes; // bumped whenever the data changes, so that virtual cells are made again
+	int num_virtual; // virtual columns
+
+	int ring; // rows kept by every column, 0 if unlimited
+
+	int *view; // columns to print, in order. NULL to print them all
+	int view_count;
+
+	struct table_print_filter_t *filter; // rows to print, NULL to print them all
+	unsigned long long *selection; // bit per row, set if the row passes the filter
+	int selection_size; // in words
+
+	/* Out of core storage. Once the blocks of the columns take more than
+	 * 'memory_budget' bytes, complete block rows are moved to 'spill'. */
+	size_t memory_budget; // 0 if unlimited
+	size_t memory_used;
+	FILE *spill;
+	int spilled_rows;
+	int spill_row; // spilled row in 'spill_cells'
+	struct table_print_str_t *spill_cells; // cells of the spilled row being printed
+	char *spill_buf;
+	int spill_buf_size;
+
+	/* Called once the borrowed cells are dropped */
+	struct table_print_release_t *releases;
+
+	struct table_print_snapshot_map_t *map; // table_print_load_mmap: read-only rows, NULL otherwise
+};
+
+
+struct table_print_release_t
+{
+	table_print_release_func_t func;
+	void *data;
+	struct table_print_release_t *next;
+};
+
+
+/* String that is not null terminated */
+struct table_print_str_t
+{
+	const char *str;
+	int len;
+};
+
+
+/* Distinct value of a dictionary encoded column */
+struct table_print_dict_entry_t
+{
+	char *str;
+	int len;
+	int width;
+	unsigned int hash;
+	int next; // next entry in the same bucket, -1 if none
+};
+
+
+struct table_print_dict_t
+{
+	struct table_print_dict_entry_t *entries;
+	int count;
+	int size;
+
+	int *buckets; // index of the first entry of each bucket, -1 if empty
+	int num_buckets; // power of two
+
+	const struct table_print_allocator_t *allocator;
+};
+
+
+/* Conversions of strftime that only depend on the date and the time zone */
+#define TABLE_PRINT_TIME_DATE "aAbBhCdeDFgGjmuUVwWyYzZnt%"
+
+/* Conversions made for each row from the seconds since midnight */
+#define TABLE_PRINT_TIME_CLOCK "HIklMSTRpPs"
+
+/* Longest output of a conversion made for each row, and of the ones made
+ * with strftime */
+#define TABLE_PRINT_TIME_CONVERSION 24
+#define TABLE_PRINT_TIME_STRFTIME 256
+
+
+/* Formatting of a time column. Timestamps from 'span_start' to 'span_end'
+ * (seconds, excluded) share 'pattern': 'fmt' with the date and the time zone
+ * already formatted, so only the clock conversions and %N are left. The span
+ * is a whole day, or a single second on days that are not 24 hours long or
+ * if 'fmt' has other conversions that depend on the time. */
+struct table_print_time_t
+{
+	char *fmt;
+	int nanoseconds; // values are nanoseconds, not seconds
+	int per_second; // 'fmt' depends on the time in ways only strftime knows
+	int uses_ns; // 'fmt' has %N
+
+	long long span_start;
+	long long span_end;
+	int span_clock; // seconds since midnight at 'span_start'
+	char *pattern;
+	int pattern_size;
+	char ampm[2][2][16]; // %p and %P, before and after noon
+
+	/* Last formatted value */
+	int last_valid;
+	long long last_seconds;
+	int last_ns;
+	char *out;
+	int out_len;
+	int out_size;
+
+	const struct table_print_allocator_t *allocator;
+};
+
+
+/* Strings up to this length are stored inside the cell */
+#define TABLE_PRINT_CELL_INLINE 16
+
+/* Rows per storage block */
+#define TABLE_PRINT_BLOCK_ROWS 256
+
+/* Default size of an arena chunk */
+#define TABLE_PRINT_ARENA_SIZE 4096
+
+
+/* Cell of a plain column */
+struct table_print_cell_t
+{
+	int len;
+	int borrowed; // 'u.ptr' points to storage owned by the caller, whatever the length
+	union
+	{
+		char str[TABLE_PRINT_CELL_INLINE]; // len <= TABLE_PRINT_CELL_INLINE, not null terminated
+		const char *ptr; // len > TABLE_PRINT_CELL_INLINE, points into the block arena
+	} u;
+};
+
+
+/* Chunk of memory holding the strings that do not fit in a cell */
+struct table_print_arena_t
+{
+	struct table_print_arena_t *next;
+	int used;
+	int size;
+	char data[];
+};
+
+
+/* TABLE_PRINT_BLOCK_ROWS consecutive rows of a column. The payload follows the
+ * header in the same allocation, and depends on the encoding of the column. */
+struct table_print_block_t
+{
+	int count;
+	struct table_print_cell_t *cells; // table_print_encoding_plain
+	unsigned int *codes; // table_print_encoding_dict: dictionary index of each row
+	struct table_print_arena_t *arena;
+	struct table_print_arena_t *old_arena; // ring buffers: strings of the rows being overwritten
+
+	/* table_print_encoding_delta: zigzag varint difference of each value with
+	 * the previous one in the block, the first one relative to 0 */
+	unsigned char *deltas;
+	int deltas_len;
+	int deltas_size;
+	unsigned long long last; // last value added
 };
 
 
 struct table_print_column_t
 {
+	const struct table_print_allocator_t *allocator; // that of the table
 	char *caption;
-	int max_width;
+	int caption_len;
+	int max_width; // width of the column when printed
+	int data_width; // width of the widest cell, ignoring the limit
+	int width_limit; // 0 if unlimited
+	int own_width_limit; // set with table_print_column_set_max_width
+	enum table_print_overflow_t overflow;
 	enum table_print_align_t caption_align;
 	enum table_print_align_t data_align;
-	struct list_t *data; // list of strings
+	enum table_print_encoding_t encoding;
+
+	struct table_print_block_t **blocks; // NULL for blocks moved to the spill file
+	int num_blocks;
+	int blocks_size;
+	int first_block; // first block still in memory
+	/* Fenwick tree of the rows in each block but the last, NULL while they
+	 * are all full. Needed once merges or edits leave blocks partly used. */
+	int *block_sums;
+	int locate; // block of the last row looked up in 'block_sums', -1 if none
+	int locate_start; // its first row
+	int count;
+	size_t mem; // bytes used by blocks and arenas
+
+	struct table_print_dict_t *dict; // table_print_encoding_dict
+
+	/* Ring buffer of the last 'ring' rows, 0 if the column grows. Row 0 is
+	 * in slot 'ring_start'. 'width_hist' counts the cells of each width, to
+	 * find the widest remaining cell when the widest one is overwritten. */
+	int ring;
+	int ring_start;
+	int *width_hist;
+	int width_hist_size;
+
+	/* Virtual columns: cells are made by 'func' when they are needed, and
+	 * kept in the blocks until the data of the table changes */
+	table_print_virtual_func_t func;
+	void *func_data;
+	int func_stamp; // 'changes' of the table when the cells were made, -1 if never
+	int func_full; // every row was made, not only the selected ones
+
+	/* Read-only rows of a table loaded with table_print_load_mmap. Row i
+	 * goes from 'map_heap + map_offsets[i]' to the next offset. With
+	 * 'map_codes', offsets are those of dictionary entries, one per code. */
+	const char *map_heap;
+	const unsigned long long *map_offsets;
+	const unsigned int *map_codes;
+
+	/* table_print_encoding_delta */
+	int is_signed; // values added with table_print_data_add_int32
+	char digits[24]; // last decoded value
+	struct table_print_time_t *time; // table_print_column_set_time, NULL for plain integers
+	struct table_print_block_t *cursor_block; // decoding position, to walk rows in order
+	int cursor_index;
+	int cursor_offset;
+	unsigned long long cursor_value;
+};
+
+
+enum table_print_filter_kind_t
+{
+	table_print_filter_kind_number = 0,
+	table_print_filter_kind_str,
+	table_print_filter_kind_and,
+	table_print_filter_kind_or,
+};
+
+
+/* Node of a filter tree. Leaves compare the cells of column 'col' with
+ * 'number' or 'str', inner nodes combine 'left' and 'right'. */
+struct table_print_filter_t
+{
+	enum table_print_filter_kind_t kind;
+	int col;
+	enum table_print_cmp_t cmp;
+	double number;
+	char *str;
+	int len;
+
+	struct table_print_filter_t *left;
+	struct table_print_filter_t *right;
+};
+
+
+/* Writes 'len' bytes of 'str' in a field of 'width' characters, padding with spaces */
+typedef void (*table_print_place_func_t)(char *field, int width, const char *str, int len);
+
+
+struct table_print_plan_column_t
+{
+	struct table_print_column_t *col;
+	int index; // position of the column in the table
+	int width;
+	int offset; // offset of the field inside the row line
+	enum table_print_overflow_t overflow;
+	table_print_place_func_t place;
+
+	/* Part of the cell still to be printed in continuation lines */
+	const char *rest;
+	int rest_len;
+};
+
+
+/* Everything table_print_print needs to emit rows for a given layout. Rows
+ * are built in 'line', which already holds borders and separators, so each
+ * row costs one field placement per column and a single fwrite. */
+struct table_print_plan_t
+{
+	const struct table_print_allocator_t *allocator;
+	int num_columns;
+	struct table_print_plan_column_t *columns;
+
+	char *border; // full border line, including left spaces and newline
+	int border_len;
+	char *header; // full caption line
+	int header_len;
+	char *line; // row line being built
+	int line_len;
+};
+
+
+static void table_print_plan_free(struct table_print_plan_t *plan);
+static void table_print_virtual_eval(struct table_print_t *tp, const unsigned long long *selection);
+
+
+/*
+ * Memory
+ */
+
+static void *table_print_libc_malloc(size_t size, void *ctx)
+{
+	(void) ctx;
+	return malloc(size);
+}
+
+
+static void *table_print_libc_realloc(void *ptr, size_t size, void *ctx)
+{
+	(void) ctx;
+	return realloc(ptr, size);
+}
+
+
+static void table_print_libc_free(void *ptr, void *ctx)
+{
+	(void) ctx;
+	free(ptr);
+}
+
+
+static const struct table_print_allocator_t table_print_libc_allocator =
+{
+	table_print_libc_malloc,
+	table_print_libc_realloc,
+	table_print_libc_free,
+	NULL
 };
 
 
-char* strdup_printf(const char *fmt, ...)
+/* Everything a table allocates goes through its allocator, including its logs,
+ * directory scans, double buffered snapshots and asynchronous prints. As
+ * with the C library, NULL is returned when out of memory. */
+void *table_print_mem_malloc(const struct table_print_allocator_t *allocator, size_t size)
+{
+	return allocator->malloc_func(size, allocator->ctx);
+}
+
+
+void *table_print_mem_calloc(const struct table_print_allocator_t *allocator, size_t count, size_t size)
+{
+	void *ptr = allocator->malloc_func(count * size, allocator->ctx);
+
+	if (ptr)
+		memset(ptr, 0, count * size);
+	return ptr;
+}
+
+
+void *table_print_mem_realloc(const struct table_print_allocator_t *allocator, void *ptr, size_t size)
+{
+	if (!ptr)
+		return allocator->malloc_func(size, allocator->ctx);
+	return allocator->realloc_func(ptr, size, allocator->ctx);
+}
+
+
+void table_print_mem_free(const struct table_print_allocator_t *allocator, void *ptr)
+{
+	if (ptr)
+		allocator->free_func(ptr, allocator->ctx);
+}
+
+
+static char *table_print_mem_strdup(const struct table_print_allocator_t *allocator, const char *str)
+{
+	size_t len = strlen(str);
+	char *dup;
+
+	dup = table_print_mem_malloc(allocator, len + 1);
+	if (dup)
+		memcpy(dup, str, len + 1);
+	return dup;
+}
+
+
+static char *table_print_mem_vprintf(const struct table_print_allocator_t *allocator, const char *fmt, va_list args)
+{
+	char *temp;
+	int len;
+	va_list args_copy;
+
+	va_copy(args_copy, args);
+	len = vsnprintf(NULL, 0, fmt, args_copy);
+	va_end(args_copy);
+
+	temp = table_print_mem_malloc(allocator, len + 1);
+	if (!temp)
+		fatal("%s: out of memory", __FUNCTION__);
+
+	vsnprintf(temp, len + 1, fmt, args);
+
+	return temp;
+}
+
+
+static char *table_print_mem_printf(const struct table_print_allocator_t *allocator, const char *fmt, ...)
+{
+	char *temp;
+	va_list args;
+
+	va_start(args, fmt);
+	temp = table_print_mem_vprintf(allocator, fmt, args);
+	va_end(args);
+
+	return temp;
+}
+
+
+char* strdup_vprintf(const char *fmt, va_list args)
+{
+	return table_print_mem_vprintf(&table_print_libc_allocator, fmt, args);
+}
+
+
+char* strdup_printf(const char *fmt, ...)
+{
+	char *temp;
+	va_list args;
+
+	va_start(args, fmt);
+	temp = strdup_vprintf(fmt, args);
+	va_end(args);
+
+	return temp;
+}
+
+
+struct linked_list_t *str_token_list_create(const char *str, char *delim)
+{
+	struct linked_list_t *token_list;
+	char *token;
+	char *tmp;
+
+	/* Create list */
+	token_list = linked_list_create();
+
+	/* Split string into tokens */
+	tmp = strdup(str);
+	token = strtok(tmp, delim);
+	while (token)
+	{
+		/* Insert in token list */
+		token = strdup(token);
+		linked_list_add(token_list, token);
+
+		/* Next token */
+		token = strtok(NULL, delim);
+	}
+
+	/* Free copy of 'str' */
+	free(tmp);
+
+	/* Return token list */
+	return token_list;
+}
+
+
+void str_token_list_free(struct linked_list_t *token_list)
+{
+	LINKED_LIST_FOR_EACH(token_list)
+		free(linked_list_get(token_list));
+	linked_list_free(token_list);
+}
+
+
+/*
+ * Dictionary
+ */
+
+static unsigned int table_print_dict_hash(const char *str, int len)
+{
+	unsigned int hash = 2166136261u;
+	int i;
+
+	/* FNV-1a */
+	for (i = 0; i < len; i++)
+	{
+		hash ^= (unsigned char) str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+static struct table_print_dict_t *table_print_dict_create(const struct table_print_allocator_t *allocator)
+{
+	struct table_print_dict_t *dict;
+
+	dict = table_print_mem_calloc(allocator, 1, sizeof(struct table_print_dict_t));
+	if (!dict)
+		fatal("%s: out of memory", __FUNCTION__);
+	dict->allocator = allocator;
+
+	dict->num_buckets = 16;
+	dict->buckets = table_print_mem_malloc(allocator, dict->num_buckets * sizeof(int));
+	if (!dict->buckets)
+		fatal("%s: out of memory", __FUNCTION__);
+	memset(dict->buckets, -1, dict->num_buckets * sizeof(int));
+
+	return dict;
+}
+
+
+static void table_print_dict_free(struct table_print_dict_t *dict)
+{
+	int i;
+
+	for (i = 0; i < dict->count; i++)
+		table_print_mem_free(dict->allocator, dict->entries[i].str);
+	table_print_mem_free(dict->allocator, dict->entries);
+	table_print_mem_free(dict->allocator, dict->buckets);
+	table_print_mem_free(dict->allocator, dict);
+}
+
+
+static void table_print_dict_rehash(struct table_print_dict_t *dict)
+{
+	int i;
+
+	dict->num_buckets *= 2;
+	dict->buckets = table_print_mem_realloc(dict->allocator, dict->buckets, dict->num_buckets * sizeof(int));
+	if (!dict->buckets)
+		fatal("%s: out of memory", __FUNCTION__);
+	memset(dict->buckets, -1, dict->num_buckets * sizeof(int));
+
+	for (i = 0; i < dict->count; i++)
+	{
+		struct table_print_dict_entry_t *entry = &dict->entries[i];
+		int bucket = entry->hash & (dict->num_buckets - 1);
+
+		entry->next = dict->buckets[bucket];
+		dict->buckets[bucket] = i;
+	}
+}
+
+
+/* Return the code of 'str', or -1 if it is not in the dictionary */
+static int table_print_dict_find(struct table_print_dict_t *dict, const char *str, int len, unsigned int hash)
+{
+	struct table_print_dict_entry_t *entry;
+	int i;
+
+	for (i = dict->buckets[hash & (dict->num_buckets - 1)]; i >= 0; i = dict->entries[i].next)
+	{
+		entry = &dict->entries[i];
+		if (entry->hash == hash && entry->len == len && !memcmp(entry->str, str, len))
+			return i;
+	}
+	return -1;
+}
+
+
+/* Return the code of 'str', adding it to the dictionary if it is not there yet */
+static unsigned int table_print_dict_intern(struct table_print_dict_t *dict, const char *str, int len)
+{
+	struct table_print_dict_entry_t *entry;
+	unsigned int hash;
+	int bucket;
+	int i;
+
+	hash = table_print_dict_hash(str, len);
+	bucket = hash & (dict->num_buckets - 1);
+
+	i = table_print_dict_find(dict, str, len, hash);
+	if (i >= 0)
+		return i;
+
+	/* New value */
+	if (dict->count == dict->size)
+	{
+		dict->size = dict->size ? dict->size * 2 : 16;
+		dict->entries = table_print_mem_realloc(dict->allocator, dict->entries, dict->size * sizeof(struct table_print_dict_entry_t));
+		if (!dict->entries)
+			fatal("%s: out of memory", __FUNCTION__);
+	}
+
+	i = dict->count++;
+	entry = &dict->entries[i];
+	entry->str = table_print_mem_malloc(dict->allocator, len + 1);
+	if (!entry->str)
+		fatal("%s: out of memory", __FUNCTION__);
+	memcpy(entry->str, str, len);
+	entry->str[len] = '\0';
+	entry->len = len;
+	entry->width = len;
+	entry->hash = hash;
+	entry->next = dict->buckets[bucket];
+	dict->buckets[bucket] = i;
+
+	/* Keep chains short */
+	if (dict->count > dict->num_buckets / 4 * 3)
+		table_print_dict_rehash(dict);
+
+	return i;
+}
+
+
+/*
+ * Blocks
+ */
+
+static size_t table_print_block_payload(enum table_print_encoding_t encoding)
+{
+	if (encoding == table_print_encoding_dict)
+		return TABLE_PRINT_BLOCK_ROWS * sizeof(unsigned int);
+	if (encoding == table_print_encoding_delta)
+		return 0;
+	return TABLE_PRINT_BLOCK_ROWS * sizeof(struct table_print_cell_t);
+}
+
+
+/* Memory used by a block, including its arena */
+static size_t table_print_block_size(struct table_print_block_t *block, enum table_print_encoding_t encoding)
+{
+	struct table_print_arena_t *arena;
+	size_t size;
+
+	size = sizeof(struct table_print_block_t) + table_print_block_payload(encoding) + block->deltas_size;
+	for (arena = block->arena; arena; arena = arena->next)
+		size += sizeof(struct table_print_arena_t) + arena->size;
+	for (arena = block->old_arena; arena; arena = arena->next)
+		size += sizeof(struct table_print_arena_t) + arena->size;
+	return size;
+}
+
+
+static struct table_print_block_t *table_print_block_create(const struct table_print_allocator_t *allocator,
+		enum table_print_encoding_t encoding)
+{
+	struct table_print_block_t *block;
+
+	block = table_print_mem_malloc(allocator, sizeof(struct table_print_block_t) + table_print_block_payload(encoding));
+	if (!block)
+		fatal("%s: out of memory", __FUNCTION__);
+	block->count = 0;
+	block->cells = NULL;
+	block->codes = NULL;
+	block->arena = NULL;
+	block->old_arena = NULL;
+	block->deltas = NULL;
+	block->deltas_len = 0;
+	block->deltas_size = 0;
+	block->last = 0;
+	if (encoding == table_print_encoding_dict)
+		block->codes = (unsigned int *) (block + 1);
+	else if (encoding == table_print_encoding_plain)
+		block->cells = (struct table_print_cell_t *) (block + 1);
+
+	return block;
+}
+
+
+/* Free a list of arena chunks. Returns the bytes released. */
+static size_t table_print_arena_free(const struct table_print_allocator_t *allocator, struct table_print_arena_t *arena)
+{
+	struct table_print_arena_t *next;
+	size_t size = 0;
+
+	for (; arena; arena = next)
+	{
+		next = arena->next;
+		size += sizeof(struct table_print_arena_t) + arena->size;
+		table_print_mem_free(allocator, arena);
+	}
+	return size;
+}
+
+
+static void table_print_block_free(const struct table_print_allocator_t *allocator, struct table_print_block_t *block)
+{
+	table_print_arena_free(allocator, block->arena);
+	table_print_arena_free(allocator, block->old_arena);
+	table_print_mem_free(allocator, block->deltas);
+	table_print_mem_free(allocator, block);
+}
+
+
+/* Copy a string that does not fit in a cell into the block arena. Returns the
+ * copy, and adds the size of a new arena chunk to 'mem' if one was needed. */
+static const char *table_print_block_strdup(const struct table_print_allocator_t *allocator, struct table_print_block_t *block,
+		const char *str, int len, size_t *mem)
+{
+	struct table_print_arena_t *arena = block->arena;
+	char *dst;
+
+	if (!arena || arena->size - arena->used < len)
+	{
+		int size = len > TABLE_PRINT_ARENA_SIZE ? len : TABLE_PRINT_ARENA_SIZE;
+
+		arena = table_print_mem_malloc(allocator, sizeof(struct table_print_arena_t) + size);
+		if (!arena)
+			fatal("%s: out of memory", __FUNCTION__);
+		arena->used = 0;
+		arena->size = size;
+		arena->next = block->arena;
+		block->arena = arena;
+		*mem += sizeof(struct table_print_arena_t) + size;
+	}
+
+	dst = arena->data + arena->used;
+	memcpy(dst, str, len);
+	arena->used += len;
+	return dst;
+}
+
+
+/*
+ * Times
+ */
+
+/* Length of the conversion at 'spec', which starts with '%': flags, width,
+ * modifier and conversion character. 0 if 'spec' is cut. */
+static int table_print_time_spec_len(const char *spec)
+{
+	int len = 1;
+
+	while (spec[len] && strchr("_-0^#", spec[len]))
+		len++;
+	while (spec[len] >= '0' && spec[len] <= '9')
+		len++;
+	if (spec[len] == 'E' || spec[len] == 'O')
+		len++;
+	return spec[len] ? len + 1 : 0;
+}
+
+
+/* Whether the conversion of 'len' characters at 'spec' is made for each row */
+static int table_print_time_spec_clock(const char *spec, int len)
+{
+	int i;
+
+	if (spec[len - 1] == 'N')
+	{
+		for (i = 1; i < len - 1; i++)
+			if (spec[i] < '0' || spec[i] > '9')
+				return FALSE;
+		return TRUE;
+	}
+	return len == 2 && strchr(TABLE_PRINT_TIME_CLOCK, spec[1]);
+}
+
+
+static struct table_print_time_t *table_print_time_create(const struct table_print_allocator_t *allocator,
+		const char *fmt, int nanoseconds)
+{
+	struct table_print_time_t *time;
+	const char *p;
+
+	time = table_print_mem_calloc(allocator, 1, sizeof(struct table_print_time_t));
+	if (!time)
+		fatal("%s: out of memory", __FUNCTION__);
+	time->allocator = allocator;
+	time->fmt = table_print_mem_strdup(allocator, fmt);
+	time->nanoseconds = nanoseconds;
+
+	for (p = strchr(fmt, '%'); p; p = strchr(p, '%'))
+	{
+		int len = table_print_time_spec_len(p);
+
+		if (!len)
+			break;
+		if (p[len - 1] == 'N' && table_print_time_spec_clock(p, len))
+			time->uses_ns = TRUE;
+		else if (!table_print_time_spec_clock(p, len) && !strchr(TABLE_PRINT_TIME_DATE, p[len - 1]))
+			time->per_second = TRUE;
+		p += len;
+	}
+	return time;
+}
+
+
+static void table_print_time_free(struct table_print_time_t *time)
+{
+	table_print_mem_free(time->allocator, time->fmt);
+	table_print_mem_free(time->allocator, time->pattern);
+	table_print_mem_free(time->allocator, time->out);
+	table_print_mem_free(time->allocator, time);
+}
+
+
+/* Append 'len' characters to the pattern, doubling '%' if 'escape' */
+static void table_print_time_append(struct table_print_time_t *time, int *used, const char *str, int len, int escape)
+{
+	int i;
+
+	if (*used + 2 * len + 1 > time->pattern_size)
+	{
+		time->pattern_size = (*used + 2 * len + 1) * 2;
+		time->pattern = table_print_mem_realloc(time->allocator, time->pattern, time->pattern_size);
+		if (!time->pattern)
+			fatal("%s: out of memory", __FUNCTION__);
+	}
+	for (i = 0; i < len; i++)
+	{
+		time->pattern[(*used)++] = str[i];
+		if (escape && str[i] == '%')
+			time->pattern[(*used)++] = '%';
+	}
+	time->pattern[*used] = '\0';
+}
+
+
+/* Make the pattern of the span of 'seconds' */
+static void table_print_time_span(struct table_print_time_t *time, long long seconds)
+{
+	char buf[TABLE_PRINT_TIME_STRFTIME];
+	char spec[TABLE_PRINT_TIME_CONVERSION];
+	struct tm tm;
+	struct tm edge;
+	time_t t = seconds;
+	const char *p;
+	int used = 0;
+	int i;
+
+	if (!localtime_r(&t, &tm))
+		memset(&tm, 0, sizeof(tm));
+	time->span_clock = tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+	time->span_start = seconds;
+	time->span_end = seconds + 1;
+
+	/* Midnight and the last second of the day must be 24 hours apart in
+	 * the same time zone */
+	if (!time->per_second)
+	{
+		t = seconds - time->span_clock;
+		if (localtime_r(&t, &edge) && !edge.tm_hour && !edge.tm_min && !edge.tm_sec && edge.tm_mday == tm.tm_mday)
+		{
+			t += 86399;
+			if (localtime_r(&t, &edge) && edge.tm_hour == 23 && edge.tm_min == 59 && edge.tm_sec == 59 &&
+					edge.tm_mday == tm.tm_mday)
+			{
+				time->span_start = seconds - time->span_clock;
+				time->span_end = time->span_start + 86400;
+				time->span_clock = 0;
+			}
+		}
+	}
+
+	table_print_time_append(time, &used, "", 0, FALSE);
+	for (p = time->fmt; *p; )
+	{
+		const char *q = strchr(p, '%');
+		int len;
+
+		if (!q)
+			q = p + strlen(p);
+		table_print_time_append(time, &used, p, q - p, TRUE);
+		p = q;
+		if (!*p)
+			break;
+
+		len = table_print_time_spec_len(p);
+		if (!len || len >= (int) sizeof(spec))
+		{
+			/* Cut or too long, kept as it is */
+			len = len ? len : (int) strlen(p);
+			table_print_time_append(time, &used, p, len, TRUE);
+		}
+		else if (!time->per_second && table_print_time_spec_clock(p, len))
+			table_print_time_append(time, &used, p, len, FALSE);
+		else if (p[len - 1] == 'N' && table_print_time_spec_clock(p, len))
+			table_print_time_append(time, &used, p, len, FALSE);
+		else
+		{
+			memcpy(spec, p, len);
+			spec[len] = '\0';
+			table_print_time_append(time, &used, buf, strftime(buf, sizeof(buf), spec, &tm), TRUE);
+		}
+		p += len;
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		edge = tm;
+		edge.tm_hour = i ? 13 : 1;
+		if (!strftime(time->ampm[0][i], sizeof(time->ampm[0][i]), "%p", &edge))
+			time->ampm[0][i][0] = '\0';
+		if (!strftime(time->ampm[1][i], sizeof(time->ampm[1][i]), "%P", &edge))
+			time->ampm[1][i][0] = '\0';
+	}
+
+	/* Every conversion left is 2 characters or more */
+	if (used * TABLE_PRINT_TIME_CONVERSION / 2 + 1 > time->out_size)
+	{
+		time->out_size = used * TABLE_PRINT_TIME_CONVERSION / 2 + 1;
+		time->out = table_print_mem_realloc(time->allocator, time->out, time->out_size);
+		if (!time->out)
+			fatal("%s: out of memory", __FUNCTION__);
+	}
+}
+
+
+/* Write 'value' with 'digits' digits, padded with 'pad' */
+static char *table_print_time_put(char *out, int value, int digits, char pad)
+{
+	int i;
+
+	for (i = digits - 1; i >= 0; i--)
+	{
+		out[i] = value || i == digits - 1 ? '0' + value % 10 : pad;
+		value /= 10;
+	}
+	return out + digits;
+}
+
+
+/* Format 'value'. The string is not null terminated and is overwritten by the
+ * next call, its length is returned in 'len'. */
+static const char *table_print_time_format(struct table_print_time_t *time, unsigned long long value, int is_signed,
+		int *len)
+{
+	long long seconds = value;
+	const char *p;
+	char *out;
+	int hour12;
+	int clock;
+	int ns = 0;
+
+	if (time->nanoseconds)
+	{
+		if (is_signed)
+		{
+			seconds = (long long) value / 1000000000;
+			ns = (long long) value % 1000000000;
+		}
+		else
+		{
+			seconds = value / 1000000000;
+			ns = value % 1000000000;
+		}
+		if (ns < 0)
+		{
+			ns += 1000000000;
+			seconds--;
+		}
+	}
+
+	if (time->last_valid && seconds == time->last_seconds && (!time->uses_ns || ns == time->last_ns))
+	{
+		*len = time->out_len;
+		return time->out;
+	}
+
+	if (seconds < time->span_start || seconds >= time->span_end || !time->pattern)
+		table_print_time_span(time, seconds);
+	clock = time->span_clock + (seconds - time->span_start);
+	hour12 = (clock / 3600) % 12 ? (clock / 3600) % 12 : 12;
+
+	out = time->out;
+	for (p = time->pattern; *p; p++)
+	{
+		int digits;
+
+		if (*p != '%')
+		{
+			*out++ = *p;
+			continue;
+		}
+		switch (*++p)
+		{
+		case 'H':
+			out = table_print_time_put(out, clock / 3600, 2, '0');
+			break;
+		case 'k':
+			out = table_print_time_put(out, clock / 3600, 2, ' ');
+			break;
+		case 'I':
+			out = table_print_time_put(out, hour12, 2, '0');
+			break;
+		case 'l':
+			out = table_print_time_put(out, hour12, 2, ' ');
+			break;
+		case 'M':
+			out = table_print_time_put(out, clock / 60 % 60, 2, '0');
+			break;
+		case 'S':
+			out = table_print_time_put(out, clock % 60, 2, '0');
+			break;
+		case 'R':
+		case 'T':
+			out = table_print_time_put(out, clock / 3600, 2, '0');
+			*out++ = ':';
+			out = table_print_time_put(out, clock / 60 % 60, 2, '0');
+			if (*p == 'R')
+				break;
+			*out++ = ':';
+			out = table_print_time_put(out, clock % 60, 2, '0');
+			break;
+		case 'p':
+		case 'P':
+			strcpy(out, time->ampm[*p == 'P'][clock >= 12 * 3600]);
+			out += strlen(out);
+			break;
+		case 's':
+			out += sprintf(out, "%lld", seconds);
+			break;
+		case '%':
+			*out++ = '%';
+			break;
+		default:
+			/* %N, with the number of digits before it */
+			for (digits = 0; *p >= '0' && *p <= '9'; p++)
+				digits = digits * 10 + *p - '0';
+			if (!digits || digits > 9)
+				digits = 9;
+			table_print_time_put(out, ns, 9, '0');
+			out += digits;
+			break;
+		}
+	}
+
+	time->last_valid = TRUE;
+	time->last_seconds = seconds;
+	time->last_ns = ns;
+	time->out_len = out - time->out;
+	*len = time->out_len;
+	return time->out;
+}
+
+
+/*
+ * Columns
+ */
+
+static struct table_print_column_t *table_print_column_get(struct table_print_t *tp, int col)
+{
+	linked_list_goto(tp->columns, col);
+	if (tp->columns->error_code != LINKED_LIST_ERR_OK)
+		return NULL;
+	return linked_list_get(tp->columns);
+}
+
+
+static int table_print_column_count(struct table_print_column_t *col)
+{
+	return col->count;
+}
+
+
+/* Write 'value' in decimal right before 'end'. Returns the first character. */
+static char *table_print_format_u64(char *end, unsigned long long value)
+{
+	do
+	{
+		*--end = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	return end;
+}
+
+
+static int table_print_digits(unsigned long long value, int is_signed)
+{
+	int digits = 1;
+
+	if (is_signed && (long long) value < 0)
+	{
+		value = 0 - value;
+		digits++;
+	}
+	while (value >= 10)
+	{
+		value /= 10;
+		digits++;
+	}
+	return digits;
+}
+
+
+/* Decode row 'index' of a delta encoded block. Rows read in order only
+ * decode one delta each. */
+static unsigned long long table_print_column_decode_value(struct table_print_column_t *col, struct table_print_block_t *block, int index)
+{
+	if (col->cursor_block != block || col->cursor_index > index)
+	{
+		col->cursor_block = block;
+		col->cursor_index = -1;
+		col->cursor_offset = 0;
+		col->cursor_value = 0;
+	}
+
+	while (col->cursor_index < index)
+	{
+		unsigned long long zigzag = 0;
+		int shift = 0;
+		unsigned char byte;
+
+		do
+		{
+			byte = block->deltas[col->cursor_offset++];
+			zigzag |= (unsigned long long) (byte & 0x7f) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+		col->cursor_value += (zigzag >> 1) ^ (0 - (zigzag & 1));
+		col->cursor_index++;
+	}
+	return col->cursor_value;
+}
+
+
+/* Decode row 'index' of a delta encoded block into 'digits'. Returns the first character. */
+static const char *table_print_column_decode(struct table_print_column_t *col, struct table_print_block_t *block, int index)
+{
+	unsigned long long value;
+	char *str;
+
+	value = table_print_column_decode_value(col, block, index);
+	if (col->is_signed && (long long) value < 0)
+	{
+		str = table_print_format_u64(col->digits + sizeof(col->digits), 0 - value);
+		*--str = '-';
+	}
+	else
+		str = table_print_format_u64(col->digits + sizeof(col->digits), value);
+	return str;
+}
+
+
+/* Where 'row' is stored. Rows of a ring buffer start at 'ring_start'. */
+static int table_print_column_slot(struct table_print_column_t *col, int row)
+{
+	if (!col->ring)
+		return row;
+	row += col->ring_start;
+	return row < col->ring ? row : row - col->ring;
+}
+
+
+/* Rebuild the block index of a column from the counts of its blocks */
+static void table_print_column_index_build(struct table_print_column_t *col)
+{
+	int size = col->num_blocks - 1;
+	int i;
+
+	table_print_mem_free(col->allocator, col->block_sums);
+	col->block_sums = table_print_mem_calloc(col->allocator, col->blocks_size + 1, sizeof(int));
+	if (!col->block_sums)
+		fatal("%s: out of memory", __FUNCTION__);
+	for (i = 1; i <= size; i++)
+	{
+		int parent = i + (i & -i);
+
+		col->block_sums[i] += col->blocks[i - 1]->count;
+		if (parent <= size)
+			col->block_sums[parent] += col->block_sums[i];
+	}
+	col->locate = -1;
+}
+
+
+/* Rows in the first 'blocks' blocks */
+static int table_print_column_index_prefix(struct table_print_column_t *col, int blocks)
+{
+	int sum = 0;
+
+	for (; blocks > 0; blocks -= blocks & -blocks)
+		sum += col->block_sums[blocks];
+	return sum;
+}
+
+
+/* Block 'block' gained 'delta' rows. The last block is not in the index. */
+static void table_print_column_index_add(struct table_print_column_t *col, int block, int delta)
+{
+	int size = col->num_blocks - 1;
+	int i;
+
+	for (i = block + 1; i <= size; i += i & -i)
+		col->block_sums[i] += delta;
+	col->locate = -1;
+}
+
+
+/* The block before the last one was the last one, add it to the index */
+static void table_print_column_index_append(struct table_print_column_t *col)
+{
+	int i = col->num_blocks - 1;
+
+	col->block_sums[i] = col->blocks[i - 1]->count + table_print_column_index_prefix(col, i - 1) -
+		table_print_column_index_prefix(col, i - (i & -i));
+}
+
+
+/* Block holding 'row', which must be stored in memory, and the index of the
+ * row in the block. Once blocks are partly used, the block index is searched,
+ * unless the row is in the last block or in the one found last. */
+static int table_print_column_find(struct table_print_column_t *col, int row, int *index)
+{
+	int tail_start;
+	int block, start, step;
+
+	if (!col->block_sums)
+	{
+		row = table_print_column_slot(col, row);
+		*index = row % TABLE_PRINT_BLOCK_ROWS;
+		return row / TABLE_PRINT_BLOCK_ROWS;
+	}
+
+	tail_start = col->count - col->blocks[col->num_blocks - 1]->count;
+	if (row >= tail_start)
+	{
+		*index = row - tail_start;
+		return col->num_blocks - 1;
+	}
+	if (col->locate >= 0 && row >= col->locate_start && row < col->locate_start + col->blocks[col->locate]->count)
+	{
+		*index = row - col->locate_start;
+		return col->locate;
+	}
+
+	/* Largest number of blocks holding at most 'row' rows */
+	block = 0;
+	start = 0;
+	for (step = 1; step * 2 <= col->num_blocks - 1; step *= 2)
+		;
+	for (; step; step /= 2)
+	{
+		if (block + step <= col->num_blocks - 1 && start + col->block_sums[block + step] <= row)
+		{
+			block += step;
+			start += col->block_sums[block];
+		}
+	}
+	col->locate = block;
+	col->locate_start = start;
+	*index = row - start;
+	return block;
+}
+
+
+static struct table_print_block_t *table_print_column_block(struct table_print_column_t *col, int row, int *index)
+{
+	return col->blocks[table_print_column_find(col, row, index)];
+}
+
+
+/* Dictionary code of 'row', which must be stored in memory */
+static unsigned int table_print_column_code(struct table_print_column_t *col, int row)
+{
+	struct table_print_block_t *block;
+	int index;
+
+	block = table_print_column_block(col, row, &index);
+	return block->codes[index];
+}
+
+
+/* String stored in 'row', or an empty string if the column is shorter.
+ * The string is not null terminated, its length is returned in 'len'. */
+static const char *table_print_column_cell(struct table_print_column_t *col, int row, int *len)
+{
+	struct table_print_block_t *block;
+	struct table_print_cell_t *cell;
+	int index;
+
+	if (row >= col->count || row / TABLE_PRINT_BLOCK_ROWS < col->first_block)
+	{
+		*len = 0;
+		return "";
+	}
+
+	if (col->map_heap)
+	{
+		if (col->map_codes)
+			row = col->map_codes[row];
+		*len = col->map_offsets[row + 1] - col->map_offsets[row];
+		return col->map_heap + col->map_offsets[row];
+	}
+
+	block = table_print_column_block(col, row, &index);
+
+	if (col->encoding == table_print_encoding_delta)
+	{
+		const char *str;
+
+		if (col->time)
+			return table_print_time_format(col->time, table_print_column_decode_value(col, block, index),
+					col->is_signed, len);
+		str = table_print_column_decode(col, block, index);
+		*len = col->digits + sizeof(col->digits) - str;
+		return str;
+	}
+
+	if (col->encoding == table_print_encoding_dict)
+	{
+		struct table_print_dict_entry_t *entry = &col->dict->entries[block->codes[index]];
+		*len = entry->len;
+		return entry->str;
+	}
+
+	cell = &block->cells[index];
+	*len = cell->len;
+	return cell->len <= TABLE_PRINT_CELL_INLINE && !cell->borrowed ? cell->u.str : cell->u.ptr;
+}
+
+
+/* Width of delta encoded 'value' once printed */
+static int table_print_column_value_width(struct table_print_column_t *col, unsigned long long value)
+{
+	int len;
+
+	if (!col->time)
+		return table_print_digits(value, col->is_signed);
+	table_print_time_format(col->time, value, col->is_signed, &len);
+	return len;
+}
+
+
+/* Width of row 'index' of a block */
+static int table_print_column_cell_width(struct table_print_column_t *col, struct table_print_block_t *block, int index)
+{
+	if (col->encoding == table_print_encoding_dict)
+		return col->dict->entries[block->codes[index]].width;
+	if (col->encoding == table_print_encoding_delta)
+		return table_print_column_value_width(col, table_print_column_decode_value(col, block, index));
+	return block->cells[index].len;
+}
+
+
+/* Count a cell of 'width' characters in the width histogram, or uncount it if
+ * 'delta' is -1. Ring buffers and edited columns keep the histogram. */
+static void table_print_column_count_width(struct table_print_column_t *col, int width, int delta)
+{
+	if (width >= col->width_hist_size)
+	{
+		int size = col->width_hist_size * 2 > width + 1 ? col->width_hist_size * 2 : width + 1;
+
+		col->width_hist = table_print_mem_realloc(col->allocator, col->width_hist, size * sizeof(int));
+		if (!col->width_hist)
+			fatal("%s: out of memory", __FUNCTION__);
+		memset(col->width_hist + col->width_hist_size, 0, (size - col->width_hist_size) * sizeof(int));
+		col->width_hist_size = size;
+	}
+	col->width_hist[width] += delta;
+
+	if (delta > 0 && width > col->data_width)
+		col->data_width = width;
+	while (col->data_width && !col->width_hist[col->data_width])
+		col->data_width--;
+}
+
+
+/* Account for a new cell of 'width' characters */
+static void table_print_column_grow(struct table_print_column_t *col, int width)
+{
+	if (width <= col->data_width)
+		return;
+	col->data_width = width;
+	if (col->width_limit && width > col->width_limit)
+		width = col->width_limit;
+	if (width > col->max_width)
+		col->max_width = width;
+}
+
+
+/* Printed width of the column if its widest cell is 'data_width' characters */
+static int table_print_column_width(struct table_print_column_t *col, int data_width)
+{
+	int caption_width = col->caption_len;
+
+	if (col->width_limit)
+	{
+		if (caption_width > col->width_limit)
+			caption_width = col->width_limit;
+		if (data_width > col->width_limit)
+			data_width = col->width_limit;
+	}
+	return caption_width > data_width ? caption_width : data_width;
+}
+
+
+/* Recompute the printed width after the limit changed */
+static void table_print_column_update_width(struct table_print_column_t *col)
+{
+	col->max_width = table_print_column_width(col, col->data_width);
+}
+
+
+/* Block where the next row of the column goes */
+static struct table_print_block_t *table_print_column_tail(struct table_print_column_t *col)
+{
+	struct table_print_block_t *block;
+
+	if (col->num_blocks)
+	{
+		block = col->blocks[col->num_blocks - 1];
+		if (block && block->count < TABLE_PRINT_BLOCK_ROWS)
+			return block;
+	}
+
+	if (col->num_blocks == col->blocks_size)
+	{
+		col->blocks_size = col->blocks_size ? col->blocks_size * 2 : 4;
+		col->blocks = table_print_mem_realloc(col->allocator, col->blocks, col->blocks_size * sizeof(struct table_print_block_t *));
+		if (!col->blocks)
+			fatal("%s: out of memory", __FUNCTION__);
+		if (col->block_sums)
+		{
+			col->block_sums = table_print_mem_realloc(col->allocator, col->block_sums, (col->blocks_size + 1) * sizeof(int));
+			if (!col->block_sums)
+				fatal("%s: out of memory", __FUNCTION__);
+		}
+	}
+	block = table_print_block_create(col->allocator, col->encoding);
+	col->blocks[col->num_blocks++] = block;
+	if (col->block_sums)
+		table_print_column_index_append(col);
+	col->mem += table_print_block_size(block, col->encoding);
+	return block;
+}
+
+
+/* Allocate every block of a ring buffer */
+static void table_print_column_ring_init(struct table_print_column_t *col)
+{
+	int i;
+
+	col->num_blocks = (col->ring + TABLE_PRINT_BLOCK_ROWS - 1) / TABLE_PRINT_BLOCK_ROWS;
+	col->blocks_size = col->num_blocks;
+	col->blocks = table_print_mem_calloc(col->allocator, col->num_blocks + 1, sizeof(struct table_print_block_t *));
+	if (!col->blocks)
+		fatal("%s: out of memory", __FUNCTION__);
+	for (i = 0; i < col->num_blocks; i++)
+	{
+		col->blocks[i] = table_print_block_create(col->allocator, col->encoding);
+		col->mem += table_print_block_size(col->blocks[i], col->encoding);
+	}
+	col->ring_start = 0;
+}
+
+
+/* Store a cell in a ring buffer, overwriting the oldest row if it is full */
+static void table_print_column_ring_add(struct table_print_column_t *col, const char *str, int len, int borrowed)
+{
+	struct table_print_block_t *block;
+	struct table_print_cell_t *cell;
+	int slot;
+	int index;
+	int last;
+	int width = len;
+
+	if (col->count < col->ring)
+	{
+		slot = table_print_column_slot(col, col->count);
+		col->count++;
+	}
+	else
+	{
+		slot = col->ring_start;
+		col->ring_start = slot + 1 < col->ring ? slot + 1 : 0;
+		table_print_column_count_width(col, table_print_column_cell_width(col,
+				col->blocks[slot / TABLE_PRINT_BLOCK_ROWS], slot % TABLE_PRINT_BLOCK_ROWS), -1);
+	}
+
+	block = col->blocks[slot / TABLE_PRINT_BLOCK_ROWS];
+	index = slot % TABLE_PRINT_BLOCK_ROWS;
+	if (index >= block->count)
+		block->count = index + 1;
+
+	/* The strings of a block are dropped once all of its rows have been
+	 * overwritten, a whole lap later */
+	last = col->ring - (slot - index) < TABLE_PRINT_BLOCK_ROWS ? col->ring - (slot - index) - 1 : TABLE_PRINT_BLOCK_ROWS - 1;
+	if (index == 0)
+	{
+		col->mem -= table_print_arena_free(col->allocator, block->old_arena);
+		block->old_arena = block->arena;
+		block->arena = NULL;
+	}
+
+	if (col->encoding == table_print_encoding_dict)
+	{
+		unsigned int code = table_print_dict_intern(col->dict, str, len);
+
+		block->codes[index] = code;
+		width = col->dict->entries[code].width;
+	}
+	else
+	{
+		cell = &block->cells[index];
+		cell->len = len;
+		cell->borrowed = borrowed;
+		if (borrowed)
+			cell->u.ptr = str;
+		else if (len <= TABLE_PRINT_CELL_INLINE)
+			memcpy(cell->u.str, str, len);
+		else
+			cell->u.ptr = table_print_block_strdup(col->allocator, block, str, len, &col->mem);
+	}
+
+	if (index == last)
+	{
+		col->mem -= table_print_arena_free(col->allocator, block->old_arena);
+		block->old_arena = NULL;
+	}
+
+	table_print_column_count_width(col, width, 1);
+	table_print_column_update_width(col);
+}
+
+
+static void table_print_column_add_str(struct table_print_column_t *col, const char *str, int len)
+{
+	struct table_print_block_t *block;
+	struct table_print_cell_t *cell;
+
+	if (col->ring)
+	{
+		table_print_column_ring_add(col, str, len, FALSE);
+		return;
+	}
+
+	block = table_print_column_tail(col);
+
+	if (col->encoding == table_print_encoding_dict)
+	{
+		unsigned int code;
+		int count = col->dict->count;
+
+		code = table_print_dict_intern(col->dict, str, len);
+		block->codes[block->count++] = code;
+		col->count++;
+
+		/* Only a new dictionary entry can make the column wider */
+		if (col->dict->count != count)
+			table_print_column_grow(col, col->dict->entries[code].width);
+		if (col->width_hist)
+			table_print_column_count_width(col, col->dict->entries[code].width, 1);
+		return;
+	}
+
+	cell = &block->cells[block->count++];
+	cell->len = len;
+	cell->borrowed = FALSE;
+	if (len <= TABLE_PRINT_CELL_INLINE)
+		memcpy(cell->u.str, str, len);
+	else
+		cell->u.ptr = table_print_block_strdup(col->allocator, block, str, len, &col->mem);
+	col->count++;
+
+	table_print_column_grow(col, len);
+	if (col->width_hist)
+		table_print_column_count_width(col, len, 1);
+}
+
+
+/* Add strings without copying them, up to the end of the tail block. Returns
+ * the number of strings added. Dictionary encoded columns still copy the values
+ * they have not seen yet. */
+static int table_print_column_add_refs(struct table_print_column_t *col, const char *const *str, const int *len, int n)
+{
+	struct table_print_block_t *block;
+	int width = 0;
+	int i;
+
+	if (col->ring)
+	{
+		for (i = 0; i < n; i++)
+		{
+			const char *s = str[i] ? str[i] : "";
+
+			table_print_column_ring_add(col, s, len ? len[i] : (int) strlen(s), TRUE);
+		}
+		return n;
+	}
+
+	block = table_print_column_tail(col);
+	if (n > TABLE_PRINT_BLOCK_ROWS - block->count)
+		n = TABLE_PRINT_BLOCK_ROWS - block->count;
+
+	for (i = 0; i < n; i++)
+	{
+		const char *s = str[i] ? str[i] : "";
+		int l = len ? len[i] : (int) strlen(s);
+
+		if (col->encoding == table_print_encoding_dict)
+		{
+			table_print_column_add_str(col, s, l);
+			continue;
+		}
+
+		block->cells[block->count].len = l;
+		block->cells[block->count].borrowed = TRUE;
+		block->cells[block->count].u.ptr = s;
+		block->count++;
+		if (l > width)
+			width = l;
+	}
+
+	if (col->encoding != table_print_encoding_dict)
+	{
+		col->count += n;
+		table_print_column_grow(col, width);
+		if (col->width_hist)
+			for (i = block->count - n; i < block->count; i++)
+				table_print_column_count_width(col, block->cells[i].len, 1);
+	}
+	return n;
+}
+
+
+/* Append 'value' to the deltas of a block */
+static void table_print_block_add_delta(const struct table_print_allocator_t *allocator, struct table_print_block_t *block,
+		unsigned long long value, size_t *mem)
+{
+	unsigned long long zigzag;
+	long long delta;
+
+	delta = (long long) (value - block->last);
+	zigzag = ((unsigned long long) delta << 1) ^ (unsigned long long) (delta >> 63);
+
+	if (block->deltas_size - block->deltas_len < 10)
+	{
+		int size = block->deltas_size ? block->deltas_size * 2 : 64;
+
+		block->deltas = table_print_mem_realloc(allocator, block->deltas, size);
+		if (!block->deltas)
+			fatal("%s: out of memory", __FUNCTION__);
+		*mem += size - block->deltas_size;
+		block->deltas_size = size;
+	}
+	while (zigzag >= 0x80)
+	{
+		block->deltas[block->deltas_len++] = (zigzag & 0x7f) | 0x80;
+		zigzag >>= 7;
+	}
+	block->deltas[block->deltas_len++] = zigzag;
+	block->last = value;
+	block->count++;
+}
+
+
+static void table_print_column_add_integer(struct table_print_column_t *col, unsigned long long value, int is_signed)
+{
+	int width;
+
+	if (!col->count)
+		col->is_signed = is_signed;
+
+	table_print_block_add_delta(col->allocator, table_print_column_tail(col), value, &col->mem);
+	col->count++;
+
+	width = table_print_column_value_width(col, value);
+	table_print_column_grow(col, width);
+	if (col->width_hist)
+		table_print_column_count_width(col, width, 1);
+}
+
+
+void table_print_column_add(struct table_print_t *tp, const char *caption, enum table_print_align_t caption_align, enum table_print_align_t data_align)
+{
+	struct table_print_column_t *col;
+
+	if (tp->map)
+		fatal("%s: table loaded from a snapshot is read-only", __FUNCTION__);
+	col = table_print_mem_calloc(&tp->allocator, 1, sizeof(struct table_print_column_t));
+	if (!col)
+		fatal("%s: out of memory", __FUNCTION__);
+	col->allocator = &tp->allocator;
+	col->func_stamp = -1;
+	if (tp->show_header)
+	{
+		col->caption = table_print_mem_strdup(col->allocator, caption ? caption : "");
+		col->caption_len = strlen(col->caption);
+		col->max_width = col->caption_len;
+	}
+	else
+	{
+		col->caption = NULL;
+		col->caption_len = 0;
+		col->max_width = 0;
+	}
+	col->caption_align = caption_align;
+	col->data_align = data_align;
+	col->encoding = table_print_encoding_plain;
+	col->width_limit = tp->width_limit;
+	col->overflow = tp->overflow;
+	table_print_column_update_width(col);
+	col->ring = tp->ring;
+	if (col->ring)
+		table_print_column_ring_init(col);
+
+	linked_list_add(tp->columns, col);
+	tp->changes++;
+}
+
+
+void table_print_column_set_encoding(struct table_print_t *tp, int col, enum table_print_encoding_t encoding)
+{
+	struct table_print_column_t *c;
+
+	c = table_print_column_get(tp, col);
+	if (!c)
+		fatal("%s: column %d does not exist", __FUNCTION__, col);
+	if (table_print_column_count(c))
+		fatal("%s: column %d already contains data", __FUNCTION__, col);
+	if (c->ring && encoding == table_print_encoding_delta)
+		fatal("%s: column %d is a ring buffer and cannot be delta encoded", __FUNCTION__, col);
+	if (c->func && encoding != table_print_encoding_plain)
+		fatal("%s: column %d is virtual", __FUNCTION__, col);
+
+	if (c->dict)
+	{
+		table_print_dict_free(c->dict);
+		c->dict = NULL;
+	}
+	if (encoding == table_print_encoding_dict)
+		c->dict = table_print_dict_create(c->allocator);
+	if (c->time && encoding != table_print_encoding_delta)
+	{
+		table_print_time_free(c->time);
+		c->time = NULL;
+	}
+
+	/* Ring buffer blocks are allocated up front for the encoding */
+	if (c->ring && c->encoding != encoding)
+	{
+		int i;
+
+		for (i = 0; i < c->num_blocks; i++)
+			table_print_block_free(c->allocator, c->blocks[i]);
+		table_print_mem_free(c->allocator, c->blocks);
+		c->mem = 0;
+		c->encoding = encoding;
+		table_print_column_ring_init(c);
+	}
+	c->encoding = encoding;
+}
+
+
+void table_print_column_set_time(struct table_print_t *tp, int col, const char *fmt, enum table_print_time_unit_t unit)
+{
+	struct table_print_column_t *c;
+
+	table_print_column_set_encoding(tp, col, table_print_encoding_delta);
+	c = table_print_column_get(tp, col);
+	if (c->time)
+		table_print_time_free(c->time);
+	c->time = table_print_time_create(c->allocator, fmt ? fmt : "%Y-%m-%d %H:%M:%S",
+			unit == table_print_time_nanoseconds);
+}
+
+
+void table_print_column_set_max_width(struct table_print_t *tp, int col, int max_width, enum table_print_overflow_t overflow)
+{
+	struct table_print_column_t *c;
+
+	c = table_print_column_get(tp, col);
+	if (!c)
+		fatal("%s: column %d does not exist", __FUNCTION__, col);
+
+	c->own_width_limit = max_width > 0;
+	c->width_limit = c->own_width_limit ? max_width : tp->width_limit;
+	c->overflow = c->own_width_limit ? overflow : tp->overflow;
+	table_print_column_update_width(c);
+}
+
+
+void table_print_set_max_width(struct table_print_t *tp, int max_width, enum table_print_overflow_t overflow)
+{
+	tp->width_limit = max_width > 0 ? max_width : 0;
+	tp->overflow = overflow;
+
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+
+		if (col->own_width_limit)
+			continue;
+		col->width_limit = tp->width_limit;
+		col->overflow = tp->overflow;
+		table_print_column_update_width(col);
+	}
+}
+
+
+void table_print_column_free(struct table_print_column_t *col)
+{
+	int i;
+
+	for (i = col->first_block; i < col->num_blocks; i++)
+		table_print_block_free(col->allocator, col->blocks[i]);
+	table_print_mem_free(col->allocator, col->blocks);
+	if (col->dict)
+		table_print_dict_free(col->dict);
+	if (col->time)
+		table_print_time_free(col->time);
+	if (col->caption)
+		table_print_mem_free(col->allocator, col->caption);
+	table_print_mem_free(col->allocator, col->width_hist);
+	table_print_mem_free(col->allocator, col->block_sums);
+	table_print_mem_free(col->allocator, col);
+}
+
+
+struct table_print_t* table_print_create(FILE *fout, int show_borders, int show_header, int spaces_left, int spaces_between)
+{
+	return table_print_create_with_allocator(fout, show_borders, show_header, spaces_left, spaces_between, NULL);
+}
+
+
+struct table_print_t *table_print_create_with_allocator(FILE *fout, int show_borders, int show_header, int spaces_left,
+		int spaces_between, const struct table_print_allocator_t *allocator)
+{
+	struct table_print_t *tp;
+
+	if (!allocator)
+		allocator = &table_print_libc_allocator;
+	tp = table_print_mem_calloc(allocator, 1, sizeof(struct table_print_t));
+	if (!tp)
+		fatal("%s: out of memory", __FUNCTION__);
+	tp->allocator = *allocator;
+	tp->fout = fout;
+	tp->spaces_left = spaces_left;
+	tp->spaces_between = spaces_between;
+	tp->show_borders = show_borders;
+	tp->show_header = show_header;
+	tp->double_fmt = table_print_mem_strdup(allocator, "%.3f");
+	tp->int32_fmt = table_print_mem_strdup(allocator, "%d");
+	tp->columns = linked_list_create_with_allocator(allocator->malloc_func, allocator->free_func, allocator->ctx);
+	tp->spill_row = -1;
+
+	return tp;
+}
+
+
+/* Call the release functions, in the order they were added */
+static void table_print_release(struct table_print_t *tp)
+{
+	struct table_print_release_t *release, *next, *reversed = NULL;
+
+	for (release = tp->releases; release; release = next)
+	{
+		next = release->next;
+		release->next = reversed;
+		reversed = release;
+	}
+	tp->releases = NULL;
+
+	for (release = reversed; release; release = next)
+	{
+		next = release->next;
+		release->func(release->data);
+		table_print_mem_free(&tp->allocator, release);
+	}
+}
+
+
+void table_print_free(struct table_print_t *tp)
+{
+	struct table_print_allocator_t allocator;
+
+	LINKED_LIST_FOR_EACH(tp->columns)
+		table_print_column_free(linked_list_get(tp->columns));
+	table_print_release(tp);
+
+	linked_list_free(tp->columns);
+	if (tp->plan)
+		table_print_plan_free(tp->plan);
+	if (tp->spill)
+		fclose(tp->spill);
+	table_print_mem_free(&tp->allocator, tp->spill_cells);
+	table_print_mem_free(&tp->allocator, tp->spill_buf);
+	table_print_mem_free(&tp->allocator, tp->view);
+	if (tp->filter)
+		table_print_filter_free(tp->filter);
+	table_print_mem_free(&tp->allocator, tp->selection);
+	table_print_mem_free(&tp->allocator, tp->double_fmt);
+	table_print_mem_free(&tp->allocator, tp->int32_fmt);
+
+	/* The allocator is part of the table */
+	allocator = tp->allocator;
+	table_print_mem_free(&allocator, tp);
+}
+
+
+struct table_print_t *table_print_create_like(struct table_print_t *tp)
+{
+	struct table_print_t *like;
+
+	like = table_print_create_with_allocator(tp->fout, tp->show_borders, tp->show_header, tp->spaces_left,
+			tp->spaces_between, &tp->allocator);
+	table_print_set_double_fmt(like, tp->double_fmt);
+	table_print_set_int32_fmt(like, tp->int32_fmt);
+	like->width_limit = tp->width_limit;
+	like->overflow = tp->overflow;
+	like->memory_budget = tp->memory_budget;
+	like->ring = tp->ring;
+
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+		struct table_print_column_t *c;
+
+		table_print_column_add(like, col->caption, col->caption_align, col->data_align);
+		linked_list_tail(like->columns);
+		c = linked_list_get(like->columns);
+
+		table_print_column_set_encoding(like, linked_list_count(like->columns) - 1, col->encoding);
+		if (col->time)
+			c->time = table_print_time_create(c->allocator, col->time->fmt, col->time->nanoseconds);
+		c->func = col->func;
+		c->func_data = col->func_data;
+		like->num_virtual += col->func != NULL;
+		c->own_width_limit = col->own_width_limit;
+		c->width_limit = col->width_limit;
+		c->overflow = col->overflow;
+		table_print_column_update_width(c);
+	}
+
+	return like;
+}
+
+
+static void table_print_column_clear(struct table_print_column_t *col)
+{
+	int i;
+
+	for (i = col->first_block; i < col->num_blocks; i++)
+		table_print_block_free(col->allocator, col->blocks[i]);
+	table_print_mem_free(col->allocator, col->blocks);
+	col->blocks = NULL;
+	col->num_blocks = 0;
+	col->blocks_size = 0;
+	col->first_block = 0;
+	table_print_mem_free(col->allocator, col->block_sums);
+	col->block_sums = NULL;
+	col->map_heap = NULL;
+	col->map_offsets = NULL;
+	col->map_codes = NULL;
+	col->count = 0;
+	col->mem = 0;
+	col->cursor_block = NULL;
+
+	/* Entries must be seen again to widen the column */
+	if (col->dict)
+	{
+		table_print_dict_free(col->dict);
+		col->dict = table_print_dict_create(col->allocator);
+	}
+
+	col->data_width = 0;
+	if (col->ring)
+	{
+		memset(col->width_hist, 0, col->width_hist_size * sizeof(int));
+		table_print_column_ring_init(col);
+	}
+	else
+	{
+		table_print_mem_free(col->allocator, col->width_hist);
+		col->width_hist = NULL;
+		col->width_hist_size = 0;
+	}
+	table_print_column_update_width(col);
+}
+
+
+/* Store a merged column again in full blocks, for the spill file. Strings
+ * are copied. Returns the change in memory use. */
+static long long table_print_column_compact(struct table_print_column_t *col)
+{
+	struct table_print_column_t old = *col;
+	int row;
+	int i;
+
+	if (!col->block_sums)
+		return 0;
+
+	col->blocks = NULL;
+	col->num_blocks = 0;
+	col->blocks_size = 0;
+	col->block_sums = NULL;
+	col->width_hist = NULL;
+	col->width_hist_size = 0;
+	col->count = 0;
+	col->mem = 0;
+	col->cursor_block = NULL;
+
+	for (row = 0; row < old.count; row++)
+	{
+		struct table_print_block_t *block;
+		const char *str;
+		int index;
+		int len;
+
+		if (old.encoding == table_print_encoding_delta)
+		{
+			block = table_print_column_block(&old, row, &index);
+			table_print_column_add_integer(col, table_print_column_decode_value(&old, block, index), old.is_signed);
+			continue;
+		}
+		str = table_print_column_cell(&old, row, &len);
+		table_print_column_add_str(col, str, len);
+	}
+
+	for (i = 0; i < old.num_blocks; i++)
+		table_print_block_free(old.allocator, old.blocks[i]);
+	table_print_mem_free(col->allocator, old.blocks);
+	table_print_mem_free(col->allocator, old.block_sums);
+	table_print_mem_free(col->allocator, old.width_hist);
+	return (long long) col->mem - (long long) old.mem;
+}
+
+
+void table_print_clear(struct table_print_t *tp)
+{
+	LINKED_LIST_FOR_EACH(tp->columns)
+		table_print_column_clear(linked_list_get(tp->columns));
+	table_print_release(tp);
+	tp->map = NULL;
+	tp->changes++;
+
+	if (tp->spill)
+		fclose(tp->spill);
+	tp->spill = NULL;
+	tp->spilled_rows = 0;
+	tp->spill_row = -1;
+	tp->memory_used = 0;
+	tp->rows = 0;
+}
+
+
+void table_print_set_double_fmt(struct table_print_t *tp, const char *fmt)
+{
+	table_print_mem_free(&tp->allocator, tp->double_fmt);
+	tp->double_fmt = table_print_mem_strdup(&tp->allocator, fmt);
+}
+
+
+void table_print_set_int32_fmt(struct table_print_t *tp, const char *fmt)
+{
+	table_print_mem_free(&tp->allocator, tp->int32_fmt);
+	tp->int32_fmt = table_print_mem_strdup(&tp->allocator, fmt);
+}
+
+
+/*
+ * Spill file
+ *
+ * Rows are written one after another as the number of cells followed by the
+ * length (varint) and bytes of each cell. Time columns are left empty: they
+ * take a byte or two a row, so they stay in memory and keep their values.
+ */
+
+static void table_print_spill_put_varint(FILE *f, unsigned int value)
+{
+	while (value >= 0x80)
+	{
+		putc((value & 0x7f) | 0x80, f);
+		value >>= 7;
+	}
+	putc(value, f);
+}
+
+
+static unsigned int table_print_spill_get_varint(FILE *f)
+{
+	unsigned int value = 0;
+	int shift = 0;
+	int c;
+
+	do
+	{
+		c = getc(f);
+		if (c == EOF)
+			fatal("%s: spill file truncated", __FUNCTION__);
+		value |= (unsigned int) (c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return value;
+}
+
+
+/* Move the block rows that are complete in every column to the spill file */
+static void table_print_spill(struct table_print_t *tp)
+{
+	int complete = -1;
+	int row;
+
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+
+		if (!col->func && (complete < 0 || col->count < complete))
+			complete = col->count;
+	}
+	complete -= complete % TABLE_PRINT_BLOCK_ROWS;
+	if (complete <= tp->spilled_rows)
+		return;
+
+	if (!tp->spill)
+	{
+		tp->spill = tmpfile();
+		if (!tp->spill)
+			fatal("%s: cannot create spill file", __FUNCTION__);
+	}
+
+	for (row = tp->spilled_rows; row < complete; row++)
+	{
+		table_print_spill_put_varint(tp->spill, linked_list_count(tp->columns));
+		LINKED_LIST_FOR_EACH(tp->columns)
+		{
+			struct table_print_column_t *col = linked_list_get(tp->columns);
+			const char *cell = "";
+			int len = 0;
+
+			/* Virtual cells are made again when read back, time
+			 * columns stay in memory */
+			if (!col->func && !col->time)
+				cell = table_print_column_cell(col, row, &len);
+			table_print_spill_put_varint(tp->spill, len);
+			fwrite(cell, 1, len, tp->spill);
+		}
+	}
+	if (ferror(tp->spill))
+		fatal("%s: cannot write spill file", __FUNCTION__);
+
+	/* Release the blocks */
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+
+		if (col->func || col->time)
+			continue;
+		for (; col->first_block < complete / TABLE_PRINT_BLOCK_ROWS; col->first_block++)
+		{
+			struct table_print_block_t *block = col->blocks[col->first_block];
+			size_t size = table_print_block_size(block, col->encoding);
+
+			col->mem -= size;
+			tp->memory_used -= size;
+			if (col->cursor_block == block)
+				col->cursor_block = NULL;
+			table_print_block_free(col->allocator, block);
+			col->blocks[col->first_block] = NULL;
+		}
+	}
+	tp->spilled_rows = complete;
+}
+
+
+/* Rewind the spill file to read it from the first row */
+static void table_print_spill_rewind(struct table_print_t *tp)
+{
+	tp->spill_cells = table_print_mem_realloc(&tp->allocator, tp->spill_cells, (linked_list_count(tp->columns) + 1) * sizeof(struct table_print_str_t));
+	if (!tp->spill_cells)
+		fatal("%s: out of memory", __FUNCTION__);
+	rewind(tp->spill);
+	tp->spill_row = -1;
+}
+
+
+/* Read the next spilled row into 'spill_cells', indexed by column */
+static void table_print_spill_read_row(struct table_print_t *tp)
+{
+	int num_columns = linked_list_count(tp->columns);
+	int count;
+	int size = 0;
+	int i;
+
+	count = table_print_spill_get_varint(tp->spill);
+	for (i = 0; i < count; i++)
+	{
+		int len = table_print_spill_get_varint(tp->spill);
+
+		if (size + len > tp->spill_buf_size)
+		{
+			tp->spill_buf_size = (size + len) * 2;
+			tp->spill_buf = table_print_mem_realloc(&tp->allocator, tp->spill_buf, tp->spill_buf_size);
+			if (!tp->spill_buf)
+				fatal("%s: out of memory", __FUNCTION__);
+		}
+		if (fread(tp->spill_buf + size, 1, len, tp->spill) != (size_t) len)
+			fatal("%s: spill file truncated", __FUNCTION__);
+
+		/* Offsets for now, the buffer may still move */
+		if (i < num_columns)
+		{
+			tp->spill_cells[i].str = NULL;
+			tp->spill_cells[i].len = len;
+		}
+		size += len;
+	}
+
+	size = 0;
+	for (i = 0; i < num_columns; i++)
+	{
+		if (i < count)
+		{
+			tp->spill_cells[i].str = tp->spill_buf + size;
+			size += tp->spill_cells[i].len;
+		}
+		else
+		{
+			tp->spill_cells[i].str = "";
+			tp->spill_cells[i].len = 0;
+		}
+	}
+
+	/* Time columns from memory, then virtual cells if they were made for
+	 * this row, as they may read the times */
+	tp->spill_row++;
+	i = 0;
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+
+		if (col->time)
+			tp->spill_cells[i].str = table_print_column_cell(col, tp->spill_row, &tp->spill_cells[i].len);
+		i++;
+	}
+	if (tp->num_virtual)
+	{
+		i = 0;
+		LINKED_LIST_FOR_EACH(tp->columns)
+		{
+			struct table_print_column_t *col = linked_list_get(tp->columns);
+
+			if (col->func)
+				tp->spill_cells[i].str = table_print_column_cell(col, tp->spill_row, &tp->spill_cells[i].len);
+			i++;
+		}
+	}
+}
+
+
+void table_print_set_memory_budget(struct table_print_t *tp, size_t bytes)
+{
+	if (bytes && tp->ring)
+		fatal("%s: a ring buffer cannot spill rows", __FUNCTION__);
+	if (bytes)
+		LINKED_LIST_FOR_EACH(tp->columns)
+			tp->memory_used += table_print_column_compact(linked_list_get(tp->columns));
+	tp->memory_budget = bytes;
+	if (tp->memory_budget && tp->memory_used > tp->memory_budget)
+		table_print_spill(tp);
+}
+
+
+void table_print_set_ring(struct table_print_t *tp, int rows)
+{
+	if (rows < 0)
+		fatal("%s: invalid number of rows (%d)", __FUNCTION__, rows);
+	if (tp->memory_budget)
+		fatal("%s: a table with a memory budget cannot be a ring buffer", __FUNCTION__);
+
+	tp->ring = rows;
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+		int i;
+
+		if (table_print_column_count(col))
+			fatal("%s: column %d already contains data", __FUNCTION__, linked_list_current(tp->columns));
+		if (rows && col->encoding == table_print_encoding_delta)
+			fatal("%s: column %d is delta encoded", __FUNCTION__, linked_list_current(tp->columns));
+
+		for (i = 0; i < col->num_blocks; i++)
+			table_print_block_free(col->allocator, col->blocks[i]);
+		table_print_mem_free(col->allocator, col->blocks);
+		col->blocks = NULL;
+		col->num_blocks = 0;
+		col->blocks_size = 0;
+		col->mem = 0;
+		col->ring = rows;
+		if (rows)
+			table_print_column_ring_init(col);
+	}
+}
+
+
+/*
+ * Data
+ */
+
+static void table_print_data_add(struct table_print_t *tp, int col, const char *str, int len)
+{
+	struct table_print_column_t *c;
+	size_t mem;
+
+	c = table_print_column_get(tp, col);
+	if (!c)
+	{
+		warning("%s: column %d does not exist", __FUNCTION__, col);
+		return;
+	}
+
+	if (c->encoding == table_print_encoding_delta)
+		fatal("%s: column %d is delta encoded and only takes integers", __FUNCTION__, col);
+	if (tp->map)
+		fatal("%s: table loaded from a snapshot is read-only", __FUNCTION__);
+	if (c->func)
+		fatal("%s: column %d is virtual", __FUNCTION__, col);
+	tp->changes++;
+
+	mem = c->mem;
+	table_print_column_add_str(c, str, len);
+	tp->memory_used += c->mem - mem;
+
+	if (tp->memory_budget && tp->memory_used > tp->memory_budget)
+		table_print_spill(tp);
+}
+
+
+void table_print_data_add_str_ref(struct table_print_t *tp, int col, const char *data, int len)
+{
+	table_print_data_add_str_ref_array(tp, col, &data, &len, 1);
+}
+
+
+void table_print_data_add_str_ref_array(struct table_print_t *tp, int col, const char *const *data, const int *len, int n)
+{
+	struct table_print_column_t *c;
+	size_t mem;
+	int i;
+
+	c = table_print_column_get(tp, col);
+	if (!c)
+	{
+		warning("%s: column %d does not exist", __FUNCTION__, col);
+		return;
+	}
+
+	if (c->encoding == table_print_encoding_delta)
+		fatal("%s: column %d is delta encoded and only takes integers", __FUNCTION__, col);
+	if (tp->map)
+		fatal("%s: table loaded from a snapshot is read-only", __FUNCTION__);
+	if (c->func)
+		fatal("%s: column %d is virtual", __FUNCTION__, col);
+	tp->changes++;
+
+	/* A block at a time */
+	for (i = 0; i < n; )
+	{
+		mem = c->mem;
+		i += table_print_column_add_refs(c, data + i, len ? len + i : NULL, n - i);
+		tp->memory_used += c->mem - mem;
+
+		if (tp->memory_budget && tp->memory_used > tp->memory_budget)
+			table_print_spill(tp);
+	}
+}
+
+
+void table_print_add_release(struct table_print_t *tp, table_print_release_func_t func, void *data)
+{
+	struct table_print_release_t *release;
+
+	release = table_print_mem_calloc(&tp->allocator, 1, sizeof(struct table_print_release_t));
+	if (!release)
+		fatal("%s: out of memory", __FUNCTION__);
+	release->func = func;
+	release->data = data;
+	release->next = tp->releases;
+	tp->releases = release;
+}
+
+
+void table_print_data_add_str(struct table_print_t *tp, int col, const char *data)
+{
+	if (!data)
+		data = "";
+	table_print_data_add(tp, col, data, strlen(data));
+}
+
+
+/* Numbers are formatted on the stack, so that dictionary encoded columns
+ * do not allocate for values they already contain. */
+static void table_print_data_add_printf(struct table_print_t *tp, int col, const char *fmt, ...)
+{
+	char buf[64];
+	char *tmp;
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	if (len < (int) sizeof(buf))
+	{
+		table_print_data_add(tp, col, buf, len);
+		return;
+	}
+
+	va_start(args, fmt);
+	tmp = table_print_mem_vprintf(&tp->allocator, fmt, args);
+	va_end(args);
+	table_print_data_add_str(tp, col, tmp);
+	table_print_mem_free(&tp->allocator, tmp);
+}
+
+
+/* Add to a delta encoded column. Returns FALSE if the column is not one. */
+static int table_print_data_add_integer(struct table_print_t *tp, int col, unsigned long long data, int is_signed)
+{
+	struct table_print_column_t *c;
+	size_t mem;
+
+	c = table_print_column_get(tp, col);
+	if (!c || c->encoding != table_print_encoding_delta)
+		return FALSE;
+	if (tp->map)
+		fatal("%s: table loaded from a snapshot is read-only", __FUNCTION__);
+	tp->changes++;
+
+	mem = c->mem;
+	table_print_column_add_integer(c, data, is_signed);
+	tp->memory_used += c->mem - mem;
+
+	if (tp->memory_budget && tp->memory_used > tp->memory_budget)
+		table_print_spill(tp);
+	return TRUE;
+}
+
+
+void table_print_data_add_int32(struct table_print_t *tp, int col, int data)
+{
+	if (!table_print_data_add_integer(tp, col, (long long) data, TRUE))
+		table_print_data_add_printf(tp, col, tp->int32_fmt, data);
+}
+
+
+void table_print_data_add_uint64(struct table_print_t *tp, int col, unsigned long long data)
+{
+	if (!table_print_data_add_integer(tp, col, data, FALSE))
+		table_print_data_add_printf(tp, col, "%llu", data);
+}
+
+
+void table_print_data_add_double(struct table_print_t *tp, int col, double data)
+{
+	table_print_data_add_printf(tp, col, tp->double_fmt, data);
+}
+
+
+void table_print_data_add_int32_array(struct table_print_t *tp, int col, const int *data, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		table_print_data_add_int32(tp, col, data[i]);
+}
+
+
+void table_print_data_add_uint64_array(struct table_print_t *tp, int col, const unsigned long long *data, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		table_print_data_add_uint64(tp, col, data[i]);
+}
+
+
+void table_print_data_add_double_array(struct table_print_t *tp, int col, const double *data, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		table_print_data_add_double(tp, col, data[i]);
+}
+
+
+void table_print_add_row(struct table_print_t *tp, const char* fmt, ...)
+{
+	int column;
+	char *tmp;
+	char *token;
+	va_list args;
+
+	va_start(args, fmt);
+	tmp = table_print_mem_vprintf(&tp->allocator, fmt, args);
+	va_end(args);
+
+	/* Items are the lines of 'tmp', empty lines are skipped */
+	column = 0;
+	for (token = tmp; *token; token++)
+		if (*token != '\n' && (token == tmp || token[-1] == '\n'))
+			column++;
+	if (column > linked_list_count(tp->columns))
+		fatal("The number of items to add to the table is greater than the number of columns");
+
+	column = 0;
+	for (token = strtok(tmp, "\n"); token; token = strtok(NULL, "\n"))
+		table_print_data_add_str(tp, column++, token);
+
+	table_print_mem_free(&tp->allocator, tmp);
+}
+
+
+void table_print_add_to_column(struct table_print_t *tp, int column, const char* fmt, ...)
+{
+	char *tmp;
+	va_list args;
+
+	va_start(args, fmt);
+	tmp = table_print_mem_vprintf(&tp->allocator, fmt, args);
+	va_end(args);
+
+	table_print_data_add_str(tp, column, tmp);
+	table_print_mem_free(&tp->allocator, tmp);
+}
+
+
+/*
+ * Editing
+ *
+ * Cells are changed where they are stored. Blocks that are not full after a
+ * row is removed or split stay where they are, found with the block index.
+ * The width histogram of a column is made when it is first edited, and keeps
+ * its width exact from then on.
+ */
+
+/* Count the width of every cell of a column */
+static void table_print_column_hist_build(struct table_print_column_t *col)
+{
+	int i;
+	int j;
+
+	if (col->width_hist)
+		return;
+	col->width_hist_size = col->data_width + 1;
+	col->width_hist = table_print_mem_calloc(col->allocator, col->width_hist_size, sizeof(int));
+	if (!col->width_hist)
+		fatal("%s: out of memory", __FUNCTION__);
+	for (i = 0; i < col->num_blocks; i++)
+		for (j = 0; j < col->blocks[i]->count; j++)
+			col->width_hist[table_print_column_cell_width(col, col->blocks[i], j)]++;
+}
+
+
+/* Values of a delta encoded block */
+static void table_print_column_decode_block(struct table_print_column_t *col, struct table_print_block_t *block,
+		unsigned long long *values)
+{
+	int i;
+
+	for (i = 0; i < block->count; i++)
+		values[i] = table_print_column_decode_value(col, block, i);
+}
+
+
+/* Replace the values of a delta encoded block */
+static void table_print_column_encode_block(struct table_print_column_t *col, struct table_print_block_t *block,
+		const unsigned long long *values, int count)
+{
+	int i;
+
+	block->deltas_len = 0;
+	block->last = 0;
+	block->count = 0;
+	for (i = 0; i < count; i++)
+		table_print_block_add_delta(col->allocator, block, values[i], &col->mem);
+	col->cursor_block = NULL;
+}
+
+
+/* Store a string in a plain cell. A cell that owns a long enough copy in
+ * the arena reuses it. */
+static void table_print_column_store(struct table_print_column_t *col, struct table_print_block_t *block,
+		struct table_print_cell_t *cell, const char *str, int len)
+{
+	if (len <= TABLE_PRINT_CELL_INLINE)
+		memmove(cell->u.str, str, len);
+	else if (!cell->borrowed && cell->len >= len)
+		memmove((char *) cell->u.ptr, str, len);
+	else
+		cell->u.ptr = table_print_block_strdup(col->allocator, block, str, len, &col->mem);
+	cell->len = len;
+	cell->borrowed = FALSE;
+}
+
+
+/* Change a row stored in the column. 'value' is used by delta encoded columns. */
+static void table_print_column_set(struct table_print_column_t *col, int row, const char *str, int len,
+		unsigned long long value)
+{
+	unsigned long long values[TABLE_PRINT_BLOCK_ROWS];
+	struct table_print_block_t *block;
+	int index;
+
+	block = table_print_column_block(col, row, &index);
+	table_print_column_count_width(col, table_print_column_cell_width(col, block, index), -1);
+
+	if (col->encoding == table_print_encoding_dict)
+		block->codes[index] = table_print_dict_intern(col->dict, str, len);
+	else if (col->encoding == table_print_encoding_delta)
+	{
+		table_print_column_decode_block(col, block, values);
+		values[index] = value;
+		table_print_column_encode_block(col, block, values, block->count);
+	}
+	else
+		table_print_column_store(col, block, &block->cells[index], str, len);
+
+	table_print_column_count_width(col, table_print_column_cell_width(col, block, index), 1);
+	table_print_column_update_width(col);
+}
+
+
+/* Block 'block' now holds 'delta' rows more, or less */
+static void table_print_column_resize_block(struct table_print_column_t *col, int block, int delta)
+{
+	col->count += delta;
+	if (col->block_sums)
+		table_print_column_index_add(col, block, delta);
+	else if (block != col->num_blocks - 1)
+		table_print_column_index_build(col);
+}
+
+
+static void table_print_column_delete(struct table_print_column_t *col, int row)
+{
+	unsigned long long values[TABLE_PRINT_BLOCK_ROWS];
+	struct table_print_block_t *block;
+	int index;
+	int b;
+
+	b = table_print_column_find(col, row, &index);
+	block = col->blocks[b];
+	table_print_column_count_width(col, table_print_column_cell_width(col, block, index), -1);
+
+	if (col->encoding == table_print_encoding_dict)
+	{
+		memmove(block->codes + index, block->codes + index + 1, (block->count - index - 1) * sizeof(unsigned int));
+		block->count--;
+	}
+	else if (col->encoding == table_print_encoding_delta)
+	{
+		table_print_column_decode_block(col, block, values);
+		memmove(values + index, values + index + 1, (block->count - index - 1) * sizeof(unsigned long long));
+		table_print_column_encode_block(col, block, values, block->count - 1);
+	}
+	else
+	{
+		memmove(block->cells + index, block->cells + index + 1, (block->count - index - 1) * sizeof(struct table_print_cell_t));
+		block->count--;
+	}
+
+	table_print_column_resize_block(col, b, -1);
+	table_print_column_update_width(col);
+}
+
+
+/* Move the second half of full block 'b' to a new block after it. Long
+ * strings are copied to the arena of the new block. */
+static void table_print_column_split(struct table_print_column_t *col, int b)
+{
+	unsigned long long values[TABLE_PRINT_BLOCK_ROWS];
+	struct table_print_block_t *block = col->blocks[b];
+	struct table_print_block_t *next;
+	int half = TABLE_PRINT_BLOCK_ROWS / 2;
+	int i;
+
+	if (col->num_blocks == col->blocks_size)
+	{
+		col->blocks_size *= 2;
+		col->blocks = table_print_mem_realloc(col->allocator, col->blocks, col->blocks_size * sizeof(struct table_print_block_t *));
+		if (!col->blocks)
+			fatal("%s: out of memory", __FUNCTION__);
+	}
+	next = table_print_block_create(col->allocator, col->encoding);
+	col->mem += table_print_block_size(next, col->encoding);
+
+	if (col->encoding == table_print_encoding_dict)
+		memcpy(next->codes, block->codes + half, half * sizeof(unsigned int));
+	else if (col->encoding == table_print_encoding_delta)
+	{
+		table_print_column_decode_block(col, block, values);
+		table_print_column_encode_block(col, block, values, half);
+		table_print_column_encode_block(col, next, values + half, half);
+	}
+	else
+		for (i = 0; i < half; i++)
+		{
+			struct table_print_cell_t *cell = &block->cells[half + i];
+
+			next->cells[i] = *cell;
+			if (!cell->borrowed && cell->len > TABLE_PRINT_CELL_INLINE)
+				next->cells[i].u.ptr = table_print_block_strdup(col->allocator, next, cell->u.ptr, cell->len, &col->mem);
+		}
+	block->count = half;
+	next->count = half;
+
+	memmove(col->blocks + b + 2, col->blocks + b + 1, (col->num_blocks - b - 1) * sizeof(struct table_print_block_t *));
+	col->blocks[b + 1] = next;
+	col->num_blocks++;
+	table_print_column_index_build(col);
+}
+
+
+/* Insert an empty cell, or 0 if delta encoded, before 'row' */
+static void table_print_column_insert(struct table_print_column_t *col, int row)
+{
+	unsigned long long values[TABLE_PRINT_BLOCK_ROWS];
+	struct table_print_block_t *block;
+	int index;
+	int b;
+
+	if (row == col->count)
+	{
+		if (col->encoding == table_print_encoding_delta)
+			table_print_column_add_integer(col, 0, col->is_signed);
+		else
+			table_print_column_add_str(col, "", 0);
+		return;
+	}
+
+	b = table_print_column_find(col, row, &index);
+	if (col->blocks[b]->count == TABLE_PRINT_BLOCK_ROWS)
+	{
+		table_print_column_split(col, b);
+		if (index >= TABLE_PRINT_BLOCK_ROWS / 2)
+		{
+			b++;
+			index -= TABLE_PRINT_BLOCK_ROWS / 2;
+		}
+	}
+	block = col->blocks[b];
+
+	if (col->encoding == table_print_encoding_dict)
+	{
+		memmove(block->codes + index + 1, block->codes + index, (block->count - index) * sizeof(unsigned int));
+		block->codes[index] = table_print_dict_intern(col->dict, "", 0);
+		block->count++;
+	}
+	else if (col->encoding == table_print_encoding_delta)
+	{
+		table_print_column_decode_block(col, block, values);
+		memmove(values + index + 1, values + index, (block->count - index) * sizeof(unsigned long long));
+		values[index] = 0;
+		table_print_column_encode_block(col, block, values, block->count + 1);
+	}
+	else
+	{
+		memmove(block->cells + index + 1, block->cells + index, (block->count - index) * sizeof(struct table_print_cell_t));
+		block->cells[index].len = 0;
+		block->cells[index].borrowed = FALSE;
+		block->count++;
+	}
+
+	table_print_column_resize_block(col, b, 1);
+	table_print_column_count_width(col, table_print_column_cell_width(col, block, index), 1);
+	table_print_column_update_width(col);
+}
+
+
+/* Rows can only be edited while they are all in memory */
+static void table_print_edit_check(struct table_print_t *tp, const char *func)
+{
+	if (tp->map)
+		fatal("%s: table loaded from a snapshot is read-only", func);
+	if (tp->memory_budget || tp->spilled_rows)
+		fatal("%s: rows of a table with a memory budget cannot be edited", func);
+}
+
+
+void table_print_set_cell(struct table_print_t *tp, int col, int row, const char *data)
+{
+	struct table_print_column_t *c;
+	unsigned long long value = 0;
+	size_t mem;
+	int len;
+
+	c = table_print_column_get(tp, col);
+	if (!c)
+	{
+		warning("%s: column %d does not exist", __FUNCTION__, col);
+		return;
+	}
+	if (row < 0)
+	{
+		warning("%s: row %d does not exist", __FUNCTION__, row);
+		return;
+	}
+	table_print_edit_check(tp, __FUNCTION__);
+	if (c->func)
+		fatal("%s: column %d is virtual", __FUNCTION__, col);
+	/* Adding would overwrite the oldest row instead */
+	if (tp->ring && row >= c->count)
+		fatal("%s: row %d is past the end of the ring buffer", __FUNCTION__, row);
+
+	if (!data)
+		data = "";
+	len = strlen(data);
+	if (c->encoding == table_print_encoding_delta)
+	{
+		int is_signed = c->count ? c->is_signed : *data == '-';
+		char *end;
+
+		if (!is_signed && *data == '-')
+			fatal("%s: column %d only holds unsigned integers", __FUNCTION__, col);
+		value = is_signed ? (unsigned long long) strtoll(data, &end, 10) : strtoull(data, &end, 10);
+		if (!len || *end)
+			fatal("%s: column %d is delta encoded and only takes integers", __FUNCTION__, col);
+		if (row > c->count)
+			fatal("%s: column %d is delta encoded and shorter than row %d", __FUNCTION__, col, row);
+		if (row == c->count)
+		{
+			table_print_data_add_integer(tp, col, value, is_signed);
+			return;
+		}
+	}
+	else if (row >= c->count)
+	{
+		/* Rows in between are empty */
+		while (c->count < row)
+			table_print_data_add(tp, col, "", 0);
+		table_print_data_add(tp, col, data, len);
+		return;
+	}
+	tp->changes++;
+
+	mem = c->mem;
+	table_print_column_hist_build(c);
+	table_print_column_set(c, row, data, len, value);
+	tp->memory_used += c->mem - mem;
+}
+
+
+void table_print_delete_row(struct table_print_t *tp, int row)
+{
+	table_print_edit_check(tp, __FUNCTION__);
+	if (tp->ring)
+		fatal("%s: rows of a ring buffer cannot be deleted", __FUNCTION__);
+	tp->changes++;
+
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+		size_t mem = col->mem;
+
+		if (col->func || row < 0 || row >= col->count)
+			continue;
+		table_print_column_hist_build(col);
+		table_print_column_delete(col, row);
+		tp->memory_used += col->mem - mem;
+	}
+}
+
+
+void table_print_insert_row(struct table_print_t *tp, int row)
+{
+	table_print_edit_check(tp, __FUNCTION__);
+	if (tp->ring)
+		fatal("%s: rows cannot be inserted in a ring buffer", __FUNCTION__);
+	tp->changes++;
+
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+		size_t mem = col->mem;
+
+		if (col->func || row < 0 || row > col->count)
+			continue;
+		table_print_column_hist_build(col);
+		table_print_column_insert(col, row);
+		tp->memory_used += col->mem - mem;
+	}
+}
+
+
+/*
+ * Filters
+ */
+
+static struct table_print_filter_t *table_print_filter_create(enum table_print_filter_kind_t kind)
+{
+	struct table_print_filter_t *filter;
+
+	filter = calloc(1, sizeof(struct table_print_filter_t));
+	if (!filter)
+		fatal("%s: out of memory", __FUNCTION__);
+	filter->kind = kind;
+	return filter;
+}
+
+
+struct table_print_filter_t *table_print_filter_number(int col, enum table_print_cmp_t cmp, double value)
+{
+	struct table_print_filter_t *filter;
+
+	if (cmp == table_print_cmp_prefix)
+		fatal("%s: prefix comparison only applies to strings", __FUNCTION__);
+	filter = table_print_filter_create(table_print_filter_kind_number);
+	filter->col = col;
+	filter->cmp = cmp;
+	filter->number = value;
+	return filter;
+}
+
+
+struct table_print_filter_t *table_print_filter_range(int col, double min, double max)
+{
+	return table_print_filter_and(table_print_filter_number(col, table_print_cmp_ge, min),
+			table_print_filter_number(col, table_print_cmp_le, max));
+}
+
+
+struct table_print_filter_t *table_print_filter_str(int col, enum table_print_cmp_t cmp, const char *str)
+{
+	struct table_print_filter_t *filter;
+
+	filter = table_print_filter_create(table_print_filter_kind_str);
+	filter->col = col;
+	filter->cmp = cmp;
+	filter->str = strdup(str ? str : "");
+	if (!filter->str)
+		fatal("%s: out of memory", __FUNCTION__);
+	filter->len = strlen(filter->str);
+	return filter;
+}
+
+
+struct table_print_filter_t *table_print_filter_and(struct table_print_filter_t *left, struct table_print_filter_t *right)
+{
+	struct table_print_filter_t *filter;
+
+	filter = table_print_filter_create(table_print_filter_kind_and);
+	filter->left = left;
+	filter->right = right;
+	return filter;
+}
+
+
+struct table_print_filter_t *table_print_filter_or(struct table_print_filter_t *left, struct table_print_filter_t *right)
+{
+	struct table_print_filter_t *filter;
+
+	filter = table_print_filter_create(table_print_filter_kind_or);
+	filter->left = left;
+	filter->right = right;
+	return filter;
+}
+
+
+void table_print_filter_free(struct table_print_filter_t *filter)
+{
+	if (filter->left)
+		table_print_filter_free(filter->left);
+	if (filter->right)
+		table_print_filter_free(filter->right);
+	free(filter->str);
+	free(filter);
+}
+
+
+static int table_print_filter_is_leaf(struct table_print_filter_t *filter)
+{
+	return filter->kind == table_print_filter_kind_number || filter->kind == table_print_filter_kind_str;
+}
+
+
+/* Check that every column the filter looks at exists */
+static void table_print_filter_check(struct table_print_t *tp, struct table_print_filter_t *filter)
+{
+	if (!table_print_filter_is_leaf(filter))
+	{
+		table_print_filter_check(tp, filter->left);
+		table_print_filter_check(tp, filter->right);
+	}
+	else if (!table_print_column_get(tp, filter->col))
+		fatal("%s: column %d does not exist", __FUNCTION__, filter->col);
+}
+
+
+void table_print_set_filter(struct table_print_t *tp, struct table_print_filter_t *filter)
+{
+	if (filter)
+		table_print_filter_check(tp, filter);
+	if (tp->filter)
+		table_print_filter_free(tp->filter);
+	tp->filter = filter;
+	tp->changes++;
+}
+
+
+/* Whether a value that compares as 'order' (<0, 0, >0) with the filter operand passes */
+static int table_print_filter_test(enum table_print_cmp_t cmp, int order)
+{
+	switch (cmp)
+	{
+	case table_print_cmp_eq:
+		return order == 0;
+	case table_print_cmp_ne:
+		return order != 0;
+	case table_print_cmp_lt:
+		return order < 0;
+	case table_print_cmp_le:
+		return order <= 0;
+	case table_print_cmp_gt:
+		return order > 0;
+	case table_print_cmp_ge:
+		return order >= 0;
+	default:
+		return FALSE;
+	}
+}
+
+
+static int table_print_filter_match_number(struct table_print_filter_t *filter, double value)
+{
+	return table_print_filter_test(filter->cmp, (value > filter->number) - (value < filter->number));
+}
+
+
+/* Parse a cell holding a number. Returns FALSE if it holds something else.
+ * Plain decimals with up to 15 digits, like the ones formatted by
+ * table_print_data_add_double, are converted exactly without strtod. */
+static int table_print_parse_number(const char *str, int len, double *value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+		1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int decimals = -1;
+	char buf[64];
+	char *end;
+	int i = 0;
+
+	if (len && (str[0] == '-' || str[0] == '+'))
+		i++;
+	for (; i < len && digits <= 15; i++)
+	{
+		if (str[i] >= '0' && str[i] <= '9')
+		{
+			mantissa = mantissa * 10 + (str[i] - '0');
+			digits++;
+			if (decimals >= 0)
+				decimals++;
+		}
+		else if (str[i] == '.' && decimals < 0)
+			decimals = 0;
+		else
+			break;
+	}
+	if (i == len && digits && digits <= 15)
+	{
+		*value = decimals > 0 ? mantissa / powers[decimals] : mantissa;
+		if (str[0] == '-')
+			*value = -*value;
+		return TRUE;
+	}
+
+	/* Exponents, long numbers, or not a number */
+	if (!len || len >= (int) sizeof(buf) || !strchr("+-.0123456789 ", *str))
+		return FALSE;
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	*value = strtod(buf, &end);
+	return !*end;
+}
+
+
+/* Whether a cell passes leaf 'filter'. Cells that do not hold a number never
+ * pass a numeric comparison. */
+static int table_print_filter_match_str(struct table_print_filter_t *filter, const char *str, int len)
+{
+	int order;
+
+	if (filter->kind == table_print_filter_kind_number)
+	{
+		double value;
+
+		if (!table_print_parse_number(str, len, &value))
+			return FALSE;
+		return table_print_filter_match_number(filter, value);
+	}
+
+	if (filter->cmp == table_print_cmp_prefix)
+		return len >= filter->len && !memcmp(str, filter->str, filter->len);
+
+	order = memcmp(str, filter->str, len < filter->len ? len : filter->len);
+	if (!order)
+		order = (len > filter->len) - (len < filter->len);
+	return table_print_filter_test(filter->cmp, order);
+}
+
+
+/* Whether the spilled row in 'spill_cells' passes the filter */
+static int table_print_filter_match_row(struct table_print_t *tp, struct table_print_filter_t *filter)
+{
+	struct table_print_column_t *col;
+	double value;
+
+	switch (filter->kind)
+	{
+	case table_print_filter_kind_and:
+		return table_print_filter_match_row(tp, filter->left) &&
+			table_print_filter_match_row(tp, filter->right);
+	case table_print_filter_kind_or:
+		return table_print_filter_match_row(tp, filter->left) ||
+			table_print_filter_match_row(tp, filter->right);
+	default:
+		/* Times stayed in memory, numbers are compared with their values */
+		col = table_print_column_get(tp, filter->col);
+		if (filter->kind == table_print_filter_kind_number && col && col->time)
+			return table_print_get_number(tp, filter->col, tp->spill_row, &value) &&
+				table_print_filter_match_number(filter, value);
+		return table_print_filter_match_str(filter, tp->spill_cells[filter->col].str, tp->spill_cells[filter->col].len);
+	}
+}
+
+
+/* Set the bits of the rows in memory that pass leaf 'filter'. Whole blocks are
+ * scanned at once: dictionary entries are tested once and rows just look up
+ * their code, and delta encoded numbers are compared without formatting them. */
+static void table_print_filter_eval_leaf(struct table_print_t *tp, struct table_print_filter_t *filter, unsigned long long *bits)
+{
+	struct table_print_column_t *col;
+	char *match = NULL;
+	int empty;
+	int row;
+	int i;
+
+	col = table_print_column_get(tp, filter->col);
+	empty = table_print_filter_match_str(filter, "", 0);
+
+	if (col->encoding == table_print_encoding_dict && col->dict->count)
+	{
+		match = table_print_mem_malloc(&tp->allocator, col->dict->count);
+		if (!match)
+			fatal("%s: out of memory", __FUNCTION__);
+		for (i = 0; i < col->dict->count; i++)
+			match[i] = table_print_filter_match_str(filter, col->dict->entries[i].str, col->dict->entries[i].len);
+	}
+
+	/* Rows of a ring buffer, a merged column or a snapshot do not follow the
+	 * blocks, so they are tested one at a time */
+	if (col->ring || col->block_sums || col->map_heap)
+	{
+		for (row = 0; row < tp->rows; row++)
+		{
+			const char *str;
+			int len;
+			int pass = empty;
+
+			if (row < col->count && match)
+				pass = match[table_print_column_code(col, row)];
+			else if (row < col->count)
+			{
+				str = table_print_column_cell(col, row, &len);
+				pass = table_print_filter_match_str(filter, str, len);
+			}
+			bits[row / 64] |= (unsigned long long) pass << (row % 64);
+		}
+		table_print_mem_free(&tp->allocator, match);
+		return;
+	}
+
+	/* Spilled rows end at a block boundary */
+	for (row = tp->spilled_rows; row < tp->rows; row += TABLE_PRINT_BLOCK_ROWS)
+	{
+		struct table_print_block_t *block = NULL;
+		unsigned long long *word = bits + row / 64;
+		int count = 0;
+
+		if (row / TABLE_PRINT_BLOCK_ROWS < col->num_blocks)
+		{
+			block = col->blocks[row / TABLE_PRINT_BLOCK_ROWS];
+			count = block->count;
+		}
+
+		if (match)
+		{
+			for (i = 0; i < count; i++)
+				word[i / 64] |= (unsigned long long) match[block->codes[i]] << (i % 64);
+		}
+		else if (col->encoding == table_print_encoding_delta && filter->kind == table_print_filter_kind_number)
+		{
+			unsigned long long value = 0;
+			int offset = 0;
+
+			for (i = 0; i < count; i++)
+			{
+				unsigned long long zigzag = 0;
+				int shift = 0;
+				unsigned char byte;
+
+				do
+				{
+					byte = block->deltas[offset++];
+					zigzag |= (unsigned long long) (byte & 0x7f) << shift;
+					shift += 7;
+				} while (byte & 0x80);
+				value += (zigzag >> 1) ^ (0 - (zigzag & 1));
+
+				word[i / 64] |= (unsigned long long) table_print_filter_match_number(filter,
+						col->is_signed ? (double) (long long) value : (double) value) << (i % 64);
+			}
+		}
+		else
+		{
+			for (i = 0; i < count; i++)
+			{
+				const char *str;
+				int len;
+
+				str = table_print_column_cell(col, row + i, &len);
+				word[i / 64] |= (unsigned long long) table_print_filter_match_str(filter, str, len) << (i % 64);
+			}
+		}
+
+		/* Rows past the end of the column hold empty cells */
+		if (empty)
+			for (i = count; i < TABLE_PRINT_BLOCK_ROWS && row + i < tp->rows; i++)
+				word[i / 64] |= 1ULL << (i % 64);
+	}
+
+	table_print_mem_free(&tp->allocator, match);
+}
+
+
+/* Evaluate the filter over the rows in memory, into words 'first' to 'last'
+ * (excluded) of 'bits' */
+static void table_print_filter_eval(struct table_print_t *tp, struct table_print_filter_t *filter,
+		unsigned long long *bits, int first, int last)
+{
+	unsigned long long *right;
+	int i;
+
+	memset(bits + first, 0, (last - first) * sizeof(unsigned long long));
+	if (table_print_filter_is_leaf(filter))
+	{
+		table_print_filter_eval_leaf(tp, filter, bits);
+		return;
+	}
+
+	right = table_print_mem_malloc(&tp->allocator, (last + 1) * sizeof(unsigned long long));
+	if (!right)
+		fatal("%s: out of memory", __FUNCTION__);
+	table_print_filter_eval(tp, filter->left, bits, first, last);
+	table_print_filter_eval(tp, filter->right, right, first, last);
+	if (filter->kind == table_print_filter_kind_and)
+		for (i = first; i < last; i++)
+			bits[i] &= right[i];
+	else
+		for (i = first; i < last; i++)
+			bits[i] |= right[i];
+	table_print_mem_free(&tp->allocator, right);
+}
+
+
+/* Compute 'selection' for the current rows. Returns the printed width of every
+ * column counting only the selected rows. */
+static int *table_print_filter_select(struct table_print_t *tp)
+{
+	struct table_print_column_t **cols;
+	int num_columns = linked_list_count(tp->columns);
+	int words = (tp->rows + 63) / 64;
+	int *widths;
+	int row;
+	int i;
+
+	if (words > tp->selection_size)
+	{
+		tp->selection_size = words;
+		tp->selection = table_print_mem_realloc(&tp->allocator, tp->selection, words * sizeof(unsigned long long));
+		if (!tp->selection)
+			fatal("%s: out of memory", __FUNCTION__);
+	}
+	widths = table_print_mem_calloc(&tp->allocator, num_columns + 1, sizeof(int));
+	cols = table_print_mem_calloc(&tp->allocator, num_columns + 1, sizeof(struct table_print_column_t *));
+	if (!widths || !cols)
+		fatal("%s: out of memory", __FUNCTION__);
+	i = 0;
+	LINKED_LIST_FOR_EACH(tp->columns)
+		cols[i++] = linked_list_get(tp->columns);
+
+	table_print_filter_eval(tp, tp->filter, tp->selection, tp->spilled_rows / 64, words);
+
+	/* Spilled rows are tested one by one */
+	if (tp->spill)
+	{
+		table_print_spill_rewind(tp);
+		for (row = 0; row < tp->spilled_rows; row++)
+		{
+			table_print_spill_read_row(tp);
+			if (!table_print_filter_match_row(tp, tp->filter))
+			{
+				tp->selection[row / 64] &= ~(1ULL << (row % 64));
+				continue;
+			}
+			tp->selection[row / 64] |= 1ULL << (row % 64);
+			for (i = 0; i < num_columns; i++)
+				if (tp->spill_cells[i].len > widths[i])
+					widths[i] = tp->spill_cells[i].len;
+		}
+		fseek(tp->spill, 0, SEEK_END);
+	}
+
+	/* Virtual cells of the selected rows only */
+	if (tp->num_virtual)
+	{
+		table_print_virtual_eval(tp, tp->selection);
+		for (i = 0; i < num_columns; i++)
+		{
+			if (!cols[i]->func)
+				continue;
+			for (row = 0; row < tp->spilled_rows; row++)
+			{
+				int len;
+
+				if (!(tp->selection[row / 64] >> (row % 64) & 1))
+					continue;
+				table_print_column_cell(cols[i], row, &len);
+				if (len > widths[i])
+					widths[i] = len;
+			}
+		}
+	}
+
+	for (i = tp->spilled_rows / 64; i < words; i++)
+	{
+		unsigned long long bits;
+
+		for (bits = tp->selection[i]; bits; bits &= bits - 1)
+		{
+			int j;
+
+			row = i * 64 + __builtin_ctzll(bits);
+			for (j = 0; j < num_columns; j++)
+			{
+				int len;
+
+				table_print_column_cell(cols[j], row, &len);
+				if (len > widths[j])
+					widths[j] = len;
+			}
+		}
+	}
+
+	for (i = 0; i < num_columns; i++)
+		widths[i] = table_print_column_width(cols[i], widths[i]);
+	table_print_mem_free(&tp->allocator, cols);
+	return widths;
+}
+
+
+/*
+ * Virtual columns
+ */
+
+void table_print_column_add_virtual(struct table_print_t *tp, const char *caption, enum table_print_align_t caption_align,
+		enum table_print_align_t data_align, table_print_virtual_func_t func, void *data)
+{
+	struct table_print_column_t *col;
+
+	table_print_column_add(tp, caption, caption_align, data_align);
+	linked_list_tail(tp->columns);
+	col = linked_list_get(tp->columns);
+	col->func = func;
+	col->func_data = data;
+	tp->num_virtual++;
+}
+
+
+/* Whether 'filter' tests a virtual column */
+static int table_print_filter_virtual(struct table_print_t *tp, struct table_print_filter_t *filter)
+{
+	if (filter->kind == table_print_filter_kind_and || filter->kind == table_print_filter_kind_or)
+		return table_print_filter_virtual(tp, filter->left) || table_print_filter_virtual(tp, filter->right);
+	return table_print_column_get(tp, filter->col)->func != NULL;
+}
+
+
+/* Make the cells of the virtual columns that are out of date, for the rows
+ * set in 'selection', or for every row if NULL. Other rows get empty cells.
+ * Columns are made in order, row by row, so a virtual column can use the
+ * ones on its left. 'rows' must be counted. */
+static void table_print_virtual_eval(struct table_print_t *tp, const unsigned long long *selection)
+{
+	struct table_print_column_t **cols;
+	int num_cols = 0;
+	char *buf;
+	int size = 64;
+	int row;
+	int i;
+
+	if (!tp->num_virtual)
+		return;
+	cols = table_print_mem_calloc(&tp->allocator, tp->num_virtual + 1, sizeof(struct table_print_column_t *));
+	buf = table_print_mem_malloc(&tp->allocator, size);
+	if (!cols || !buf)
+		fatal("%s: out of memory", __FUNCTION__);
+
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+
+		if (!col->func || (col->func_stamp == tp->changes && (col->func_full || selection)))
+			continue;
+		table_print_column_clear(col);
+		cols[num_cols++] = col;
+	}
+
+	if (num_cols && tp->spill)
+		table_print_spill_rewind(tp);
+	for (row = 0; num_cols && row < tp->rows; row++)
+	{
+		int selected = !selection || (selection[row / 64] >> (row % 64) & 1);
+
+		/* Spilled cells are read for the callbacks */
+		if (row < tp->spilled_rows)
+			table_print_spill_read_row(tp);
+
+		for (i = 0; i < num_cols; i++)
+		{
+			int len = 0;
+
+			if (selected)
+			{
+				len = cols[i]->func(tp, row, buf, size, cols[i]->func_data);
+				if (len >= size)
+				{
+					size = len + 1;
+					buf = table_print_mem_realloc(&tp->allocator, buf, size);
+					if (!buf)
+						fatal("%s: out of memory", __FUNCTION__);
+					len = cols[i]->func(tp, row, buf, size, cols[i]->func_data);
+				}
+				if (len > size)
+					len = size;
+				if (len < 0)
+					len = 0;
+			}
+			table_print_column_add_str(cols[i], buf, len);
+		}
+	}
+	if (num_cols && tp->spill)
+		fseek(tp->spill, 0, SEEK_END);
+
+	for (i = 0; i < num_cols; i++)
+	{
+		cols[i]->func_stamp = tp->changes;
+		cols[i]->func_full = !selection;
+	}
+	table_print_mem_free(&tp->allocator, cols);
+	table_print_mem_free(&tp->allocator, buf);
+}
+
+
+const char *table_print_get_cell(struct table_print_t *tp, int col, int row, int *len)
+{
+	struct table_print_column_t *c;
+
+	c = table_print_column_get(tp, col);
+	if (!c || row < 0)
+	{
+		*len = 0;
+		return "";
+	}
+	if (row < tp->spilled_rows && !c->func && !c->time)
+	{
+		if (row != tp->spill_row)
+		{
+			*len = 0;
+			return "";
+		}
+		*len = tp->spill_cells[col].len;
+		return tp->spill_cells[col].str;
+	}
+	return table_print_column_cell(c, row, len);
+}
+
+
+int table_print_get_number(struct table_print_t *tp, int col, int row, double *value)
+{
+	struct table_print_column_t *c;
+	const char *str;
+	int len;
+
+	/* Delta encoded integers are not formatted, times are never spilled */
+	c = table_print_column_get(tp, col);
+	if (c && c->encoding == table_print_encoding_delta && (row >= tp->spilled_rows || c->time) && row >= 0 &&
+			row < c->count)
+	{
+		struct table_print_block_t *block;
+		unsigned long long integer;
+		int index;
+
+		block = table_print_column_block(c, row, &index);
+		integer = table_print_column_decode_value(c, block, index);
+		*value = c->is_signed ? (double) (long long) integer : (double) integer;
+		return TRUE;
+	}
+
+	str = table_print_get_cell(tp, col, row, &len);
+	return table_print_parse_number(str, len, value);
+}
+
+
+/*
+ * Output
+ */
+
+static void table_print_count_rows(struct table_print_t *tp)
+{
+	tp->rows = 0;
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
+		int count = table_print_column_count(col);
+		if (!col->func && tp->rows < count)
+			tp->rows = count;
+	}
+}
+
+
+static void table_print_place_left(char *field, int width, const char *str, int len)
+{
+	memcpy(field, str, len);
+	memset(field + len, ' ', width - len);
+}
+
+
+static void table_print_place_center(char *field, int width, const char *str, int len)
+{
+	int pad = (width - len) / 2;
+
+	memset(field, ' ', pad);
+	memcpy(field + pad, str, len);
+	memset(field + pad + len, ' ', width - len - pad);
+}
+
+
+static void table_print_place_right(char *field, int width, const char *str, int len)
+{
+	memset(field, ' ', width - len);
+	memcpy(field + width - len, str, len);
+}
+
+
+static table_print_place_func_t table_print_place_func(enum table_print_align_t align)
+{
+	if (align == table_print_align_left)
+		return table_print_place_left;
+	if (align == table_print_align_center)
+		return table_print_place_center;
+	return table_print_place_right;
+}
+
+
+/* Length of the first 'len' bytes of 'str' without the UTF-8 character that
+ * byte 'len' belongs to, if it is cut in the middle. Widths are counted in bytes,
+ * so a character that does not fit the column at all is cut anyway. */
+static int table_print_utf8_cut(const char *str, int len)
+{
+	int n = len;
+
+	while (n > 0 && ((unsigned char) str[n] & 0xc0) == 0x80)
+		n--;
+	return n > 0 ? n : len;
+}
+
+
+/* Place the pending part of every cell ('rest') in the row line. Cells wider
+ * than their column are cut according to the overflow policy of the column.
+ * Returns TRUE if some wrapped cell needs a continuation line. */
+static int table_print_plan_fill_line(struct table_print_plan_t *plan, int caption)
+{
+	int more = FALSE;
+	int i;
+
+	for (i = 0; i < plan->num_columns; i++)
+	{
+		struct table_print_plan_column_t *pc = &plan->columns[i];
+		const char *str = pc->rest;
+		int len = pc->rest_len;
+		char *field = plan->line + pc->offset;
+		int cut = FALSE;
+		int width = pc->width;
+
+		pc->rest_len = 0;
+		if (len > width)
+		{
+			if (pc->overflow == table_print_overflow_ellipsis && width >= 3)
+			{
+				/* the cut cell is placed in front of the "..." */
+				width -= 3;
+				cut = TRUE;
+			}
+			if (len > width)
+			{
+				int n = table_print_utf8_cut(str, width);
+				if (pc->overflow == table_print_overflow_wrap && width > 0)
+				{
+					pc->rest = str + n;
+					pc->rest_len = len - n;
+					more = TRUE;
+				}
+				len = n;
+			}
+		}
+
+		if (caption)
+			table_print_place_func(pc->col->caption_align)(field, width, str, len);
+		else
+			pc->place(field, width, str, len);
+
+		if (cut)
+			memcpy(field + width, "...", 3);
+	}
+	return more;
+}
+
+
+/* Number of columns to print */
+static int table_print_plan_count(struct table_print_t *tp)
+{
+	return tp->view ? tp->view_count : linked_list_count(tp->columns);
+}
+
+
+static void table_print_plan_free(struct table_print_plan_t *plan)
+{
+	table_print_mem_free(plan->allocator, plan->columns);
+	table_print_mem_free(plan->allocator, plan->border);
+	table_print_mem_free(plan->allocator, plan->header);
+	table_print_mem_free(plan->allocator, plan->line);
+	table_print_mem_free(plan->allocator, plan);
+}
+
+
+/* Width of a plan column. 'widths' overrides the width of the table columns if not NULL. */
+static int table_print_plan_width(struct table_print_plan_column_t *pc, const int *widths)
+{
+	return widths ? widths[pc->index] : pc->col->max_width;
+}
+
+
+static struct table_print_plan_t *table_print_plan_create(struct table_print_t *tp, const int *widths)
+{
+	struct table_print_plan_t *plan;
+	int full_width = 0;
+	int offset;
+	int spaces;
+	int i;
+
+	plan = table_print_mem_calloc(&tp->allocator, 1, sizeof(struct table_print_plan_t));
+	if (!plan)
+		fatal("%s: out of memory", __FUNCTION__);
+	plan->allocator = &tp->allocator;
+	plan->num_columns = table_print_plan_count(tp);
+	plan->columns = table_print_mem_calloc(&tp->allocator, plan->num_columns + 1, sizeof(struct table_print_plan_column_t));
+	if (!plan->columns)
+		fatal("%s: out of memory", __FUNCTION__);
+
+	/* Printed columns */
+	if (tp->view)
+	{
+		for (i = 0; i < tp->view_count; i++)
+		{
+			plan->columns[i].index = tp->view[i];
+			plan->columns[i].col = table_print_column_get(tp, tp->view[i]);
+		}
+	}
+	else
+	{
+		i = 0;
+		LINKED_LIST_FOR_EACH(tp->columns)
+		{
+			plan->columns[i].index = i;
+			plan->columns[i].col = linked_list_get(tp->columns);
+			i++;
+		}
+	}
+
+	/* Field offsets */
+	spaces = tp->spaces_between / 2;
+	offset = tp->spaces_left;
+	for (i = 0; i < plan->num_columns; i++)
+	{
+		struct table_print_plan_column_t *pc = &plan->columns[i];
+		struct table_print_column_t *col = pc->col;
+
+		if (tp->show_borders)
+			offset += 1 + spaces; // "| "
+		else if (i)
+			offset += tp->spaces_between;
+
+		pc->width = table_print_plan_width(pc, widths);
+		pc->offset = offset;
+		pc->overflow = col->overflow;
+		pc->place = table_print_place_func(col->data_align);
+
+		offset += pc->width;
+		if (tp->show_borders)
+			offset += spaces;
+		full_width += pc->width + tp->spaces_between;
+	}
+	if (tp->show_borders)
+		offset++; // closing '|'
+	plan->line_len = offset + 1;
+
+	/* Row template */
+	plan->line = table_print_mem_malloc(&tp->allocator, plan->line_len);
+	if (!plan->line)
+		fatal("%s: out of memory", __FUNCTION__);
+	memset(plan->line, ' ', plan->line_len);
+	plan->line[plan->line_len - 1] = '\n';
+	if (tp->show_borders)
+	{
+		for (i = 0; i < plan->num_columns; i++)
+			plan->line[plan->columns[i].offset - spaces - 1] = '|';
+		plan->line[plan->line_len - 2] = '|';
+	}
+
+	/* Border */
+	if (tp->show_borders)
+	{
+		full_width += plan->num_columns - 1;
+		if (full_width < 0)
+			full_width = 0;
+		plan->border_len = tp->spaces_left + 1 + full_width + 1;
+		plan->border = table_print_mem_malloc(&tp->allocator, plan->border_len);
+		if (!plan->border)
+			fatal("%s: out of memory", __FUNCTION__);
+		memset(plan->border, ' ', tp->spaces_left + 1);
+		memset(plan->border + tp->spaces_left + 1, '=', full_width);
+		plan->border[plan->border_len - 1] = '\n';
+	}
+
+	/* Header, possibly spanning several lines if captions wrap */
+	if (tp->show_header)
+	{
+		int more;
+
+		for (i = 0; i < plan->num_columns; i++)
+		{
+			plan->columns[i].rest = plan->columns[i].col->caption;
+			plan->columns[i].rest_len = plan->columns[i].col->caption_len;
+		}
+		do
+		{
+			more = table_print_plan_fill_line(plan, TRUE);
+			plan->header = table_print_mem_realloc(&tp->allocator, plan->header, plan->header_len + plan->line_len);
+			if (!plan->header)
+				fatal("%s: out of memory", __FUNCTION__);
+			memcpy(plan->header + plan->header_len, plan->line, plan->line_len);
+			plan->header_len += plan->line_len;
+		} while (more);
+	}
+
+	return plan;
+}
+
+
+/* Return the plan for the current layout, building a new one if any column
+ * changed since the last print */
+static struct table_print_plan_t *table_print_plan_get(struct table_print_t *tp, const int *widths)
+{
+	struct table_print_plan_t *plan = tp->plan;
+	int i;
+
+	if (plan && plan->num_columns == table_print_plan_count(tp))
+	{
+		for (i = 0; i < plan->num_columns; i++)
+			if (plan->columns[i].width != table_print_plan_width(&plan->columns[i], widths) ||
+					plan->columns[i].overflow != plan->columns[i].col->overflow)
+				break;
+		if (i == plan->num_columns)
+			return plan;
+	}
+
+	if (plan)
+		table_print_plan_free(plan);
+	tp->plan = table_print_plan_create(tp, widths);
+	return tp->plan;
+}
+
+
+/* Print the cells set in the 'rest' field of every plan column */
+static void table_print_plan_print_cells(struct table_print_plan_t *plan, FILE *fout)
+{
+	int more;
+
+	do
+	{
+		more = table_print_plan_fill_line(plan, FALSE);
+		fwrite(plan->line, 1, plan->line_len, fout);
+	} while (more);
+}
+
+
+static void table_print_plan_print_row(struct table_print_plan_t *plan, FILE *fout, int row)
+{
+	int i;
+
+	for (i = 0; i < plan->num_columns; i++)
+	{
+		struct table_print_plan_column_t *pc = &plan->columns[i];
+
+		pc->rest = table_print_column_cell(pc->col, row, &pc->rest_len);
+	}
+	table_print_plan_print_cells(plan, fout);
+}
+
+
+/* Stream the spilled rows back from the spill file */
+static void table_print_plan_print_spilled(struct table_print_plan_t *plan, struct table_print_t *tp)
+{
+	int row;
+	int i;
+
+	table_print_spill_rewind(tp);
+	for (row = 0; row < tp->spilled_rows; row++)
+	{
+		table_print_spill_read_row(tp);
+		if (tp->filter && !(tp->selection[row / 64] >> (row % 64) & 1))
+			continue;
+		for (i = 0; i < plan->num_columns; i++)
+		{
+			struct table_print_plan_column_t *pc = &plan->columns[i];
+
+			pc->rest = tp->spill_cells[pc->index].str;
+			pc->rest_len = tp->spill_cells[pc->index].len;
+		}
+		table_print_plan_print_cells(plan, tp->fout);
+	}
+
+	/* Keep appending at the end */
+	fseek(tp->spill, 0, SEEK_END);
+}
+
+
+void table_print_set_view(struct table_print_t *tp, const int *cols, int n)
+{
+	int i;
+
+	for (i = 0; cols && i < n; i++)
+		if (!table_print_column_get(tp, cols[i]))
+			fatal("%s: column %d does not exist", __FUNCTION__, cols[i]);
+
+	table_print_mem_free(&tp->allocator, tp->view);
+	tp->view = NULL;
+	tp->view_count = 0;
+	if (cols && n > 0)
+	{
+		tp->view = table_print_mem_malloc(&tp->allocator, n * sizeof(int));
+		if (!tp->view)
+			fatal("%s: out of memory", __FUNCTION__);
+		memcpy(tp->view, cols, n * sizeof(int));
+		tp->view_count = n;
+	}
+
+	/* Same number of columns does not mean same columns */
+	if (tp->plan)
+	{
+		table_print_plan_free(tp->plan);
+		tp->plan = NULL;
+	}
+}
+
+
+FILE *table_print_get_fout(struct table_print_t *tp)
+{
+	return tp->fout;
+}
+
+
+int table_print_get_num_columns(struct table_print_t *tp)
+{
+	return linked_list_count(tp->columns);
+}
+
+
+const struct table_print_allocator_t *table_print_get_allocator(struct table_print_t *tp)
+{
+	return &tp->allocator;
+}
+
+
+enum table_print_encoding_t table_print_get_column_encoding(struct table_print_t *tp, int col)
+{
+	struct table_print_column_t *c;
+
+	c = table_print_column_get(tp, col);
+	return c ? c->encoding : table_print_encoding_plain;
+}
+
+
+void table_print_print(struct table_print_t *tp)
+{
+	struct table_print_plan_t *plan;
+	int *widths = NULL;
+	int row;
+
+	table_print_count_rows(tp);
+	if (tp->filter && tp->num_virtual && table_print_filter_virtual(tp, tp->filter))
+		table_print_virtual_eval(tp, NULL);
+	if (tp->filter)
+		widths = table_print_filter_select(tp);
+	else
+		table_print_virtual_eval(tp, NULL);
+	plan = table_print_plan_get(tp, widths);
+	table_print_mem_free(&tp->allocator, widths);
+
+	if (tp->show_header)
+	{
+		if (tp->show_borders)
+			fwrite(plan->border, 1, plan->border_len, tp->fout);
+		fwrite(plan->header, 1, plan->header_len, tp->fout);
+	}
+	if (tp->show_borders)
+		fwrite(plan->border, 1, plan->border_len, tp->fout);
+
+	row = 0;
+	if (tp->spill)
+	{
+		table_print_plan_print_spilled(plan, tp);
+		row = tp->spilled_rows;
+	}
+	if (tp->filter)
+	{
+		int i;
+
+		for (i = row / 64; i < (tp->rows + 63) / 64; i++)
+		{
+			unsigned long long bits;
+
+			for (bits = tp->selection[i]; bits; bits &= bits - 1)
+				table_print_plan_print_row(plan, tp->fout, i * 64 + __builtin_ctzll(bits));
+		}
+	}
+	else
+	{
+		for (; row < tp->rows; row++)
+			table_print_plan_print_row(plan, tp->fout, row);
+	}
+
+	if (tp->show_borders)
+		fwrite(plan->border, 1, plan->border_len, tp->fout);
+}
+
+
+/*
+ * Group by
+ *
+ * Groups are the entries of a dictionary whose strings are the key cells of
+ * the row one after another: the code of dictionary encoded cells, and the
+ * length and bytes of any other cell. Group 'i' is the 'i'-th distinct key, so
+ * groups come out in order of first appearance.
+ */
+
+/* Number held by a cell */
+struct table_print_group_value_t
+{
+	int ok; // FALSE if the cell is not a number
+	double number;
+	unsigned long long integer; // delta encoded columns, exact
+};
+
+
+/* Running aggregate of a group */
+struct table_print_group_acc_t
+{
+	long long count; // cells holding a number
+	double sum;
+	double min;
+	double max;
+	unsigned long long int_sum;
+	unsigned long long int_min;
+	unsigned long long int_max;
+};
+
+
+struct table_print_group_by_t
+{
+	struct table_print_t *src;
+	struct table_print_column_t **keys;
+	int *empty_codes; // code of "" in dict encoded key columns, -1 if none
+	int num_keys;
+	const struct table_print_aggregate_t *aggs;
+	struct table_print_column_t **agg_cols; // NULL for table_print_agg_count
+	int num_aggs;
+
+	/* Numbers of the dictionary entries of dict encoded aggregate columns */
+	struct table_print_group_value_t **dict_values;
+
+	/* Row being added */
+	char *key;
+	int key_len;
+	int key_size;
+	struct table_print_group_value_t *values;
+
+	struct table_print_dict_t *groups;
+	long long *counts; // rows of each group
+	struct table_print_group_acc_t *accs; // 'num_aggs' per group
+	int size; // groups allocated in 'counts' and 'accs'
+};
+
+
+static void table_print_group_parse(struct table_print_column_t *col, const char *str, int len,
+		struct table_print_group_value_t *value)
+{
+	char buf[64];
+	char *end;
+
+	if (col->encoding != table_print_encoding_delta)
+	{
+		value->ok = table_print_parse_number(str, len, &value->number);
+		return;
+	}
+
+	value->ok = FALSE;
+	if (!len || len >= (int) sizeof(buf))
+		return;
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	value->integer = col->is_signed ? (unsigned long long) strtoll(buf, &end, 10) : strtoull(buf, &end, 10);
+	value->number = col->is_signed ? (double) (long long) value->integer : (double) value->integer;
+	value->ok = !*end;
+}
+
+
+/* Append a key cell to the composite key. Dictionary codes are given as 'len'
+ * with a NULL 'str'. */
+static void table_print_group_key_add(struct table_print_group_by_t *gb, const char *str, int len)
+{
+	if (gb->key_len + (int) sizeof(int) + len > gb->key_size)
+	{
+		gb->key_size = (gb->key_len + sizeof(int) + len) * 2;
+		gb->key = table_print_mem_realloc(&gb->src->allocator, gb->key, gb->key_size);
+		if (!gb->key)
+			fatal("%s: out of memory", __FUNCTION__);
+	}
+	memcpy(gb->key + gb->key_len, &len, sizeof(int));
+	gb->key_len += sizeof(int);
+	if (str)
+	{
+		memcpy(gb->key + gb->key_len, str, len);
+		gb->key_len += len;
+	}
+}
+
+
+/* Account for the row in 'key' and 'values' */
+static void table_print_group_add(struct table_print_group_by_t *gb)
+{
+	struct table_print_group_acc_t *acc;
+	unsigned int group;
+	int count = gb->groups->count;
+	int i;
+
+	group = table_print_dict_intern(gb->groups, gb->key, gb->key_len);
+	if ((int) group >= gb->size)
+	{
+		gb->size = gb->size ? gb->size * 2 : 64;
+		gb->counts = table_print_mem_realloc(&gb->src->allocator, gb->counts, gb->size * sizeof(long long));
+		gb->accs = table_print_mem_realloc(&gb->src->allocator, gb->accs, gb->size * (gb->num_aggs + 1) * sizeof(struct table_print_group_acc_t));
+		if (!gb->counts || !gb->accs)
+			fatal("%s: out of memory", __FUNCTION__);
+	}
+	if (gb->groups->count != count)
+	{
+		gb->counts[group] = 0;
+		memset(&gb->accs[group * gb->num_aggs], 0, gb->num_aggs * sizeof(struct table_print_group_acc_t));
+	}
+	gb->counts[group]++;
+
+	acc = &gb->accs[group * gb->num_aggs];
+	for (i = 0; i < gb->num_aggs; i++, acc++)
+	{
+		struct table_print_group_value_t *value = &gb->values[i];
+		struct table_print_column_t *col = gb->agg_cols[i];
+
+		if (!col || !value->ok)
+			continue;
+
+		if (!acc->count)
+		{
+			acc->min = acc->max = value->number;
+			acc->int_min = acc->int_max = value->integer;
+		}
+		if (value->number < acc->min)
+			acc->min = value->number;
+		if (value->number > acc->max)
+			acc->max = value->number;
+		if (col->is_signed ? (long long) value->integer < (long long) acc->int_min : value->integer < acc->int_min)
+			acc->int_min = value->integer;
+		if (col->is_signed ? (long long) value->integer > (long long) acc->int_max : value->integer > acc->int_max)
+			acc->int_max = value->integer;
+		acc->sum += value->number;
+		acc->int_sum += value->integer;
+		acc->count++;
+	}
+}
+
+
+/* Row 'row' of delta encoded 'col', without formatting it */
+static void table_print_group_decode(struct table_print_column_t *col, int row, struct table_print_group_value_t *value)
+{
+	struct table_print_block_t *block;
+	int index;
+
+	block = table_print_column_block(col, row, &index);
+	value->ok = TRUE;
+	value->integer = table_print_column_decode_value(col, block, index);
+	value->number = col->is_signed ? (double) (long long) value->integer : (double) value->integer;
+}
+
+
+/* Add a row still in memory. Dictionary encoded cells take the number of their
+ * entry, and delta encoded cells the integer left by decoding them. */
+static void table_print_group_add_row(struct table_print_group_by_t *gb, int row)
+{
+	const char *str;
+	int len;
+	int i;
+
+	gb->key_len = 0;
+	for (i = 0; i < gb->num_keys; i++)
+	{
+		struct table_print_column_t *col = gb->keys[i];
+
+		if (col->encoding == table_print_encoding_dict)
+		{
+			int code = gb->empty_codes[i];
+
+			if (row < col->count)
+				code = table_print_column_code(col, row);
+			table_print_group_key_add(gb, NULL, code);
+			continue;
+		}
+		str = table_print_column_cell(col, row, &len);
+		table_print_group_key_add(gb, str, len);
+	}
+
+	for (i = 0; i < gb->num_aggs; i++)
+	{
+		struct table_print_column_t *col = gb->agg_cols[i];
+		struct table_print_group_value_t *value = &gb->values[i];
+
+		if (!col)
+			continue;
+		if (row >= col->count)
+		{
+			value->ok = FALSE;
+			continue;
+		}
+		if (i && col == gb->agg_cols[i - 1])
+		{
+			*value = gb->values[i - 1];
+			continue;
+		}
+
+		if (col->encoding == table_print_encoding_dict)
+		{
+			*value = gb->dict_values[i][table_print_column_code(col, row)];
+			continue;
+		}
+
+		if (col->encoding == table_print_encoding_delta)
+		{
+			table_print_group_decode(col, row, value);
+			continue;
+		}
+		str = table_print_column_cell(col, row, &len);
+		table_print_group_parse(col, str, len, value);
+	}
+
+	table_print_group_add(gb);
+}
+
+
+/* Add the spilled row in 'spill_cells' */
+static void table_print_group_add_spilled(struct table_print_group_by_t *gb, const int *key_cols)
+{
+	struct table_print_str_t *cells = gb->src->spill_cells;
+	int i;
+
+	gb->key_len = 0;
+	for (i = 0; i < gb->num_keys; i++)
+	{
+		struct table_print_column_t *col = gb->keys[i];
+		struct table_print_str_t *cell = &cells[key_cols[i]];
+
+		if (col->encoding == table_print_encoding_dict)
+			table_print_group_key_add(gb, NULL, table_print_dict_find(col->dict, cell->str, cell->len,
+					table_print_dict_hash(cell->str, cell->len)));
+		else
+			table_print_group_key_add(gb, cell->str, cell->len);
+	}
+
+	for (i = 0; i < gb->num_aggs; i++)
+	{
+		struct table_print_column_t *col = gb->agg_cols[i];
+		struct table_print_str_t *cell = &cells[gb->aggs[i].col];
+
+		/* Times stayed in memory */
+		if (col && col->time && gb->src->spill_row < col->count)
+			table_print_group_decode(col, gb->src->spill_row, &gb->values[i]);
+		else if (col)
+			table_print_group_parse(col, cell->str, cell->len, &gb->values[i]);
+	}
+
+	table_print_group_add(gb);
+}
+
+
+static const char *table_print_agg_name(enum table_print_agg_t agg)
+{
+	switch (agg)
+	{
+	case table_print_agg_count:
+		return "count";
+	case table_print_agg_sum:
+		return "sum";
+	case table_print_agg_min:
+		return "min";
+	case table_print_agg_max:
+		return "max";
+	default:
+		return "mean";
+	}
+}
+
+
+/* Add the aggregate cells of 'group' to 'dst', starting at column 'first' */
+static void table_print_group_print(struct table_print_group_by_t *gb, struct table_print_t *dst, int first, int group)
+{
+	struct table_print_group_acc_t *acc = &gb->accs[group * gb->num_aggs];
+	int i;
+
+	for (i = 0; i < gb->num_aggs; i++, acc++)
+	{
+		struct table_print_column_t *col = gb->agg_cols[i];
+		enum table_print_agg_t agg = gb->aggs[i].agg;
+		int c = first + i;
+
+		if (agg == table_print_agg_count)
+		{
+			table_print_data_add_uint64(dst, c, gb->counts[group]);
+			continue;
+		}
+		if (!acc->count)
+		{
+			table_print_data_add(dst, c, "", 0);
+			continue;
+		}
+
+		if (col->encoding == table_print_encoding_delta && agg != table_print_agg_mean)
+		{
+			unsigned long long value = agg == table_print_agg_sum ? acc->int_sum :
+				agg == table_print_agg_min ? acc->int_min : acc->int_max;
+
+			if (col->is_signed)
+				table_print_data_add_printf(dst, c, "%lld", (long long) value);
+			else
+				table_print_data_add_uint64(dst, c, value);
+			continue;
+		}
+
+		switch (agg)
+		{
+		case table_print_agg_sum:
+			table_print_data_add_double(dst, c, acc->sum);
+			break;
+		case table_print_agg_min:
+			table_print_data_add_double(dst, c, acc->min);
+			break;
+		case table_print_agg_max:
+			table_print_data_add_double(dst, c, acc->max);
+			break;
+		default:
+			if (col->encoding == table_print_encoding_delta)
+				table_print_data_add_double(dst, c, (col->is_signed ? (double) (long long) acc->int_sum :
+						(double) acc->int_sum) / acc->count);
+			else
+				table_print_data_add_double(dst, c, acc->sum / acc->count);
+			break;
+		}
+	}
+}
+
+
+struct table_print_t *table_print_group_by(struct table_print_t *src, const int *key_cols, int num_keys,
+		const struct table_print_aggregate_t *aggs, int num_aggs)
+{
+	struct table_print_group_by_t gb;
+	struct table_print_t *dst;
+	int row;
+	int i;
+
+	memset(&gb, 0, sizeof(gb));
+	gb.src = src;
+	gb.num_keys = num_keys;
+	gb.aggs = aggs;
+	gb.num_aggs = num_aggs;
+	gb.keys = table_print_mem_calloc(&src->allocator, num_keys + 1, sizeof(struct table_print_column_t *));
+	gb.empty_codes = table_print_mem_calloc(&src->allocator, num_keys + 1, sizeof(int));
+	gb.agg_cols = table_print_mem_calloc(&src->allocator, num_aggs + 1, sizeof(struct table_print_column_t *));
+	gb.dict_values = table_print_mem_calloc(&src->allocator, num_aggs + 1, sizeof(struct table_print_group_value_t *));
+	gb.values = table_print_mem_calloc(&src->allocator, num_aggs + 1, sizeof(struct table_print_group_value_t));
+	if (!gb.keys || !gb.empty_codes || !gb.agg_cols || !gb.dict_values || !gb.values)
+		fatal("%s: out of memory", __FUNCTION__);
+
+	for (i = 0; i < num_keys; i++)
+	{
+		gb.keys[i] = table_print_column_get(src, key_cols[i]);
+		if (!gb.keys[i])
+			fatal("%s: column %d does not exist", __FUNCTION__, key_cols[i]);
+		if (gb.keys[i]->dict)
+			gb.empty_codes[i] = table_print_dict_find(gb.keys[i]->dict, "", 0, table_print_dict_hash("", 0));
+	}
+	for (i = 0; i < num_aggs; i++)
+	{
+		struct table_print_column_t *col;
+		int j;
+
+		if (aggs[i].agg == table_print_agg_count)
+			continue;
+		col = table_print_column_get(src, aggs[i].col);
+		if (!col)
+			fatal("%s: column %d does not exist", __FUNCTION__, aggs[i].col);
+		gb.agg_cols[i] = col;
+
+		if (col->encoding != table_print_encoding_dict)
+			continue;
+		gb.dict_values[i] = table_print_mem_calloc(&src->allocator, col->dict->count + 1, sizeof(struct table_print_group_value_t));
+		if (!gb.dict_values[i])
+			fatal("%s: out of memory", __FUNCTION__);
+		for (j = 0; j < col->dict->count; j++)
+			table_print_group_parse(col, col->dict->entries[j].str, col->dict->entries[j].len, &gb.dict_values[i][j]);
+	}
+
+	/* Aggregate */
+	gb.groups = table_print_dict_create(&src->allocator);
+	table_print_count_rows(src);
+	table_print_virtual_eval(src, NULL);
+	row = 0;
+	if (src->spill)
+	{
+		table_print_spill_rewind(src);
+		for (; row < src->spilled_rows; row++)
+		{
+			table_print_spill_read_row(src);
+			table_print_group_add_spilled(&gb, key_cols);
+		}
+		fseek(src->spill, 0, SEEK_END);
+	}
+	for (; row < src->rows; row++)
+		table_print_group_add_row(&gb, row);
+
+	/* Derived table */
+	dst = table_print_create_with_allocator(src->fout, src->show_borders, src->show_header, src->spaces_left,
+			src->spaces_between, &src->allocator);
+	table_print_set_double_fmt(dst, src->double_fmt);
+	table_print_set_int32_fmt(dst, src->int32_fmt);
+	table_print_set_max_width(dst, src->width_limit, src->overflow);
+	dst->memory_budget = src->memory_budget;
+	for (i = 0; i < num_keys; i++)
+	{
+		table_print_column_add(dst, gb.keys[i]->caption, gb.keys[i]->caption_align, gb.keys[i]->data_align);
+		if (gb.keys[i]->encoding == table_print_encoding_dict)
+			table_print_column_set_encoding(dst, i, table_print_encoding_dict);
+	}
+	for (i = 0; i < num_aggs; i++)
+	{
+		char *caption;
+
+		if (gb.agg_cols[i])
+			caption = table_print_mem_printf(&src->allocator, "%s(%s)", table_print_agg_name(aggs[i].agg),
+					gb.agg_cols[i]->caption ? gb.agg_cols[i]->caption : "");
+		else
+			caption = table_print_mem_strdup(&src->allocator, table_print_agg_name(aggs[i].agg));
+		table_print_column_add(dst, caption, table_print_align_center, table_print_align_right);
+		table_print_mem_free(&src->allocator, caption);
+	}
+
+	for (i = 0; i < gb.groups->count; i++)
+	{
+		const char *key = gb.groups->entries[i].str;
+		int j;
+
+		for (j = 0; j < num_keys; j++)
+		{
+			struct table_print_column_t *col = gb.keys[j];
+			int len;
+
+			memcpy(&len, key, sizeof(int));
+			key += sizeof(int);
+			if (col->encoding == table_print_encoding_dict)
+			{
+				if (len < 0)
+					table_print_data_add(dst, j, "", 0);
+				else
+					table_print_data_add(dst, j, col->dict->entries[len].str, col->dict->entries[len].len);
+				continue;
+			}
+			table_print_data_add(dst, j, key, len);
+			key += len;
+		}
+		table_print_group_print(&gb, dst, num_keys, i);
+	}
+
+	for (i = 0; i < num_aggs; i++)
+		table_print_mem_free(&src->allocator, gb.dict_values[i]);
+	table_print_mem_free(&src->allocator, gb.dict_values);
+	table_print_mem_free(&src->allocator, gb.values);
+	table_print_mem_free(&src->allocator, gb.keys);
+	table_print_mem_free(&src->allocator, gb.empty_codes);
+	table_print_mem_free(&src->allocator, gb.agg_cols);
+	table_print_mem_free(&src->allocator, gb.key);
+	table_print_mem_free(&src->allocator, gb.counts);
+	table_print_mem_free(&src->allocator, gb.accs);
+	table_print_dict_free(gb.groups);
+
+	return dst;
+}
+
+
+/*
+ * Merge
+ */
+
+/* Reads the rows of a source table in order, spilled rows first */
+struct table_print_merge_src_t
+{
+	struct table_print_t *tp;
+	int row;
+	int rows;
+
+	/* Key of the current row, for ordered merges */
+	const char *key;
+	int key_len;
+	double number;
+	int is_number;
+};
+
+
+static void table_print_merge_src_init(struct table_print_merge_src_t *ms, struct table_print_t *tp)
+{
+	ms->tp = tp;
+	ms->row = 0;
+	table_print_count_rows(tp);
+	table_print_virtual_eval(tp, NULL);
+	ms->rows = tp->rows;
+	if (tp->spill)
+	{
+		table_print_spill_rewind(tp);
+		if (tp->spilled_rows)
+			table_print_spill_read_row(tp);
+	}
+}
+
+
+static const char *table_print_merge_src_cell(struct table_print_merge_src_t *ms, int col, int *len)
+{
+	if (ms->row < ms->tp->spilled_rows)
+	{
+		*len = ms->tp->spill_cells[col].len;
+		return ms->tp->spill_cells[col].str;
+	}
+	return table_print_column_cell(table_print_column_get(ms->tp, col), ms->row, len);
+}
+
+
+static void table_print_merge_src_next(struct table_print_merge_src_t *ms)
+{
+	ms->row++;
+	if (ms->row < ms->tp->spilled_rows)
+		table_print_spill_read_row(ms->tp);
+	else if (ms->row == ms->tp->spilled_rows && ms->tp->spill)
+		/* The next spilled block is written after the rows read back */
+		fseek(ms->tp->spill, 0, SEEK_END);
+}
+
+
+/* Add the current row of 'ms' to 'dst', copying its cells */
+static void table_print_merge_copy_row(struct table_print_t *dst, struct table_print_merge_src_t *ms)
+{
+	int num_columns = linked_list_count(dst->columns);
+	int i;
+
+	for (i = 0; i < num_columns; i++)
+	{
+		struct table_print_column_t *d = table_print_column_get(dst, i);
+		struct table_print_column_t *s = table_print_column_get(ms->tp, i);
+		unsigned long long value;
+		const char *str;
+		char digits[24];
+		char *end;
+		int len;
+
+		if (d->func)
+			continue;
+		if (d->encoding != table_print_encoding_delta)
+		{
+			str = table_print_merge_src_cell(ms, i, &len);
+			table_print_data_add(dst, i, str, len);
+			continue;
+		}
+
+		/* Integers are moved without formatting them when possible */
+		if (s->encoding == table_print_encoding_delta && (ms->row >= ms->tp->spilled_rows || s->time) &&
+				ms->row < s->count)
+		{
+			struct table_print_block_t *block;
+			int index;
+
+			block = table_print_column_block(s, ms->row, &index);
+			table_print_data_add_integer(dst, i, table_print_column_decode_value(s, block, index), s->is_signed);
+			continue;
+		}
+		str = table_print_merge_src_cell(ms, i, &len);
+		if (len >= (int) sizeof(digits))
+			len = sizeof(digits) - 1;
+		memcpy(digits, str, len);
+		digits[len] = '\0';
+		value = strtoull(digits, &end, 10);
+		if (!len || *end)
+			fatal("%s: column %d is delta encoded and row %d of the source is not an integer",
+					__FUNCTION__, i, ms->row);
+		table_print_data_add_integer(dst, i, value, digits[0] == '-');
+	}
+}
+
+
+static void table_print_merge_check(struct table_print_t *dst, struct table_print_t *src)
 {
-	char *temp;
-	int len;
-	va_list args;
+	if (dst == src)
+		fatal("%s: cannot merge a table into itself", __FUNCTION__);
+	if (dst->map)
+		fatal("%s: table loaded from a snapshot is read-only", __FUNCTION__);
+	if (linked_list_count(dst->columns) != linked_list_count(src->columns))
+		fatal("%s: %d columns into %d columns", __FUNCTION__,
+				linked_list_count(src->columns), linked_list_count(dst->columns));
+}
 
-	va_start (args, fmt);
-	len = vsnprintf (NULL, 0, fmt, args);
-	va_end (args);
 
-	temp = calloc(len + 1, sizeof(char));
+/* Pad every column of 'tp' with empty cells up to 'rows' */
+static void table_print_merge_pad(struct table_print_t *tp, int rows)
+{
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
 
-	va_start (args, fmt);
-	vsnprintf (temp, len+1, fmt, args);
-	va_end (args);
+		if (col->func)
+			continue;
+		if (col->count < rows && col->encoding == table_print_encoding_delta)
+			fatal("%s: column %d is delta encoded and shorter than the table", __FUNCTION__,
+					linked_list_current(tp->columns));
+		while (col->count < rows)
+		{
+			size_t mem = col->mem;
 
-	return temp;
+			table_print_column_add_str(col, "", 0);
+			tp->memory_used += col->mem - mem;
+		}
+	}
 }
 
 
-struct list_t *str_token_list_create(const char *str, char *delim)
+/* Move the blocks of 's' to the end of 'd' */
+static void table_print_merge_column(struct table_print_column_t *d, struct table_print_column_t *s)
 {
-	struct list_t *token_list;
-	char *token;
-	char *tmp;
+	int num_blocks = s->num_blocks;
+	int i;
 
-	/* Create list */
-	token_list = list_create();
+	if (!s->count)
+		return;
 
-	/* Split string into tokens */
-	tmp = strdup(str);
-	token = strtok(tmp, delim);
-	while (token)
+	/* Codes of the source dictionary become codes of the destination one.
+	 * Blocks are only rewritten if some code changes. */
+	if (d->encoding == table_print_encoding_dict)
 	{
-		/* Insert in token list */
-		token = strdup(token);
-		list_add(token_list, token);
+		unsigned int *map;
+		int identity = TRUE;
 
-		/* Next token */
-		token = strtok(NULL, delim);
+		map = table_print_mem_malloc(d->allocator, (s->dict->count + 1) * sizeof(unsigned int));
+		if (!map)
+			fatal("%s: out of memory", __FUNCTION__);
+		for (i = 0; i < s->dict->count; i++)
+		{
+			map[i] = table_print_dict_intern(d->dict, s->dict->entries[i].str, s->dict->entries[i].len);
+			if (map[i] != (unsigned int) i)
+				identity = FALSE;
+		}
+		if (!identity)
+			for (i = 0; i < num_blocks; i++)
+			{
+				struct table_print_block_t *block = s->blocks[i];
+				int j;
+
+				for (j = 0; j < block->count; j++)
+					block->codes[j] = map[block->codes[j]];
+			}
+		table_print_mem_free(d->allocator, map);
 	}
+	if (d->encoding == table_print_encoding_delta && s->is_signed)
+		d->is_signed = TRUE;
 
-	/* Free copy of 'str' */
-	free(tmp);
+	/* An empty last block would hide the ones that follow */
+	if (d->num_blocks && !d->blocks[d->num_blocks - 1]->count)
+	{
+		d->mem -= table_print_block_size(d->blocks[d->num_blocks - 1], d->encoding);
+		table_print_block_free(d->allocator, d->blocks[--d->num_blocks]);
+	}
 
-	/* Return token list */
-	return token_list;
+	if (d->num_blocks + num_blocks > d->blocks_size)
+	{
+		d->blocks_size = d->num_blocks + num_blocks;
+		d->blocks = table_print_mem_realloc(d->allocator, d->blocks, d->blocks_size * sizeof(struct table_print_block_t *));
+		if (!d->blocks)
+			fatal("%s: out of memory", __FUNCTION__);
+	}
+
+	/* Blocks that are not full need the block index */
+	for (i = 0; i < num_blocks; i++)
+		d->blocks[d->num_blocks++] = s->blocks[i];
+	if (d->block_sums || s->block_sums || (d->count % TABLE_PRINT_BLOCK_ROWS && d->count))
+		table_print_column_index_build(d);
+	d->count += s->count;
+	d->mem += s->mem;
+	if (s->data_width > d->data_width)
+		d->data_width = s->data_width;
+	table_print_column_update_width(d);
+
+	/* Cell widths are counted again when the column is next edited */
+	table_print_mem_free(d->allocator, d->width_hist);
+	d->width_hist = NULL;
+	d->width_hist_size = 0;
+
+	/* The source keeps its dictionary, the blocks are gone */
+	s->num_blocks = 0;
+	s->mem = 0;
+	s->cursor_block = NULL;
 }
 
 
-void table_print_column_add(struct table_print_t *tp, const char *caption, enum table_print_align_t caption_align, enum table_print_align_t data_align)
+/* Blocks and releases only move between tables that share their allocator */
+static int table_print_merge_same_allocator(struct table_print_t *dst, struct table_print_t *src)
 {
-	struct table_print_column_t *col;
+	return dst->allocator.malloc_func == src->allocator.malloc_func &&
+		dst->allocator.realloc_func == src->allocator.realloc_func &&
+		dst->allocator.free_func == src->allocator.free_func &&
+		dst->allocator.ctx == src->allocator.ctx;
+}
 
-	col = calloc(1, sizeof(struct table_print_column_t));
-	col->data = list_create();
-	if (tp->show_header)
+
+void table_print_merge(struct table_print_t *dst, struct table_print_t *src)
+{
+	struct table_print_release_t *release;
+	int i;
+
+	table_print_merge_check(dst, src);
+
+	/* Rows are copied when blocks cannot be moved as they are */
+	if (dst->ring || dst->memory_budget || src->ring || src->spilled_rows || src->map ||
+			!table_print_merge_same_allocator(dst, src))
 	{
-		col->caption = strdup(caption);
-		col->max_width = strlen(caption);
+		struct table_print_merge_src_t ms;
+
+		table_print_count_rows(dst);
+		table_print_merge_pad(dst, dst->rows);
+		table_print_merge_src_init(&ms, src);
+		for (; ms.row < ms.rows; table_print_merge_src_next(&ms))
+			table_print_merge_copy_row(dst, &ms);
+		table_print_clear(src);
+		return;
 	}
-	else
+
+	table_print_count_rows(dst);
+	table_print_merge_pad(dst, dst->rows);
+	table_print_count_rows(src);
+	table_print_virtual_eval(src, NULL);
+	table_print_merge_pad(src, src->rows);
+	dst->changes++;
+
+	for (i = 0; i < linked_list_count(dst->columns); i++)
 	{
-		col->caption = NULL;
-		col->max_width = 0;
+		struct table_print_column_t *d = table_print_column_get(dst, i);
+		struct table_print_column_t *s = table_print_column_get(src, i);
+
+		if (d->func)
+			continue;
+		if (d->encoding == s->encoding)
+		{
+			dst->memory_used += s->mem;
+			table_print_merge_column(d, s);
+		}
+		else
+		{
+			int row;
+
+			/* Different encodings: copy the cells of this column only */
+			if (d->encoding == table_print_encoding_delta)
+				fatal("%s: column %d is delta encoded in the destination only", __FUNCTION__, i);
+			for (row = 0; row < s->count; row++)
+			{
+				const char *str;
+				int len;
+
+				str = table_print_column_cell(s, row, &len);
+				table_print_data_add(dst, i, str, len);
+			}
+		}
 	}
-	col->caption_align = caption_align;
-	col->data_align = data_align;
 
-	list_add(tp->columns, col);
+	/* Borrowed cells now belong to 'dst'. Releases are kept newest first. */
+	if (src->releases)
+	{
+		for (release = src->releases; release->next; release = release->next)
+			;
+		release->next = dst->releases;
+		dst->releases = src->releases;
+		src->releases = NULL;
+	}
+	table_print_clear(src);
 }
 
 
-void table_print_column_free(struct table_print_column_t *col)
+/* Order of the current rows of two sources. Numbers go before other keys. */
+static int table_print_merge_compare(struct table_print_merge_src_t *a, struct table_print_merge_src_t *b, int numeric)
 {
-	int i;
-	LIST_FOR_EACH(col->data, i)
-	{
-		char *str = list_get(col->data, i);
-		free(str);
-	}
-	list_free(col->data);
-	if (col->caption)
-		free(col->caption);
-	free(col);
+	int cmp;
+
+	if (numeric && a->is_number != b->is_number)
+		return a->is_number ? -1 : 1;
+	if (numeric && a->is_number)
+		return a->number < b->number ? -1 : a->number > b->number;
+
+	cmp = memcmp(a->key, b->key, a->key_len < b->key_len ? a->key_len : b->key_len);
+	if (cmp)
+		return cmp;
+	return a->key_len - b->key_len;
 }
 
 
-struct table_print_t* table_print_create(FILE *fout, int show_borders, int show_header, int spaces_left, int spaces_between, int min_column_width)
+/* Heap order: smaller key first, then the earlier source, to keep equal keys
+ * in the order of the sources */
+static int table_print_merge_before(struct table_print_merge_src_t *srcs, int a, int b, int numeric)
 {
-	struct table_print_t *tp;
+	int cmp = table_print_merge_compare(&srcs[a], &srcs[b], numeric);
 
-	tp = calloc(1, sizeof(struct table_print_t));
-	tp->fout = fout;
-	tp->spaces_left = spaces_left;
-	tp->spaces_between = spaces_between;
-	tp->show_borders = show_borders;
-	tp->show_header = show_header;
-	tp->min_column_width = min_column_width;
-	tp->columns = list_create();
+	return cmp < 0 || (!cmp && a < b);
+}
 
-	return tp;
+
+static void table_print_merge_load_key(struct table_print_merge_src_t *ms, int key_col, int numeric)
+{
+	ms->key = table_print_merge_src_cell(ms, key_col, &ms->key_len);
+	if (numeric)
+		ms->is_number = table_print_parse_number(ms->key, ms->key_len, &ms->number);
 }
 
 
-void table_print_free(struct table_print_t *tp)
+static void table_print_merge_sift_down(struct table_print_merge_src_t *srcs, int *heap, int size, int i, int numeric)
 {
-	int column;
-	LIST_FOR_EACH(tp->columns, column)
+	for (;;)
 	{
-		struct table_print_column_t *c = list_get(tp->columns, column);
-		table_print_column_free(c);
-	}
+		int child = 2 * i + 1;
+		int tmp;
 
-	list_free(tp->columns);
-	free(tp);
+		if (child >= size)
+			break;
+		if (child + 1 < size && table_print_merge_before(srcs, heap[child + 1], heap[child], numeric))
+			child++;
+		if (!table_print_merge_before(srcs, heap[child], heap[i], numeric))
+			break;
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
 }
 
 
-void table_print_add_row(struct table_print_t *tp, const char* fmt, ...)
+void table_print_merge_sorted(struct table_print_t *dst, struct table_print_t **srcs, int num_srcs,
+		int key_col, int numeric)
 {
-	int column;
-	int num_args;
-	char *tmp;
-	va_list args;
-	struct list_t *tokens;
+	struct table_print_merge_src_t *ms;
+	int *heap;
+	int size = 0;
+	int i;
 
-	va_start(args, fmt);
-	temp = strdup_printf()
-	va_end(args);
+	if (key_col < 0 || key_col >= linked_list_count(dst->columns))
+		fatal("%s: column %d does not exist", __FUNCTION__, key_col);
 
-	tokens = str_token_list_create(tmp, "\n");
+	ms = table_print_mem_calloc(&dst->allocator, num_srcs + 1, sizeof(struct table_print_merge_src_t));
+	heap = table_print_mem_calloc(&dst->allocator, num_srcs + 1, sizeof(int));
+	if (!ms || !heap)
+		fatal("%s: out of memory", __FUNCTION__);
 
-	if (list_count(tokens) > list_count(tp->columns))
-		fatal("The number of items to add to the table is greater than the number of columns");
+	table_print_count_rows(dst);
+	table_print_merge_pad(dst, dst->rows);
+	for (i = 0; i < num_srcs; i++)
+	{
+		table_print_merge_check(dst, srcs[i]);
+		table_print_merge_src_init(&ms[i], srcs[i]);
+		if (ms[i].row < ms[i].rows)
+		{
+			table_print_merge_load_key(&ms[i], key_col, numeric);
+			heap[size++] = i;
+		}
+	}
 
-	LIST_FOR_EACH(tokens, column)
+	for (i = size / 2 - 1; i >= 0; i--)
+		table_print_merge_sift_down(ms, heap, size, i, numeric);
+
+	while (size)
 	{
-		char *data = list_get(tp->columns, column);
-		if (data)
-			column_add_str(column, data);
+		struct table_print_merge_src_t *top = &ms[heap[0]];
+
+		table_print_merge_copy_row(dst, top);
+		table_print_merge_src_next(top);
+		if (top->row < top->rows)
+			table_print_merge_load_key(top, key_col, numeric);
+		else
+			heap[0] = heap[--size];
+		table_print_merge_sift_down(ms, heap, size, 0, numeric);
 	}
 
-	list_free(tokens);
-	free(tmp);
+	for (i = 0; i < num_srcs; i++)
+		table_print_clear(srcs[i]);
+	table_print_mem_free(&dst->allocator, heap);
+	table_print_mem_free(&dst->allocator, ms);
 }
 
 
-void table_print_add_to_column(struct table_print_t *tp, int column, const char* fmt, ...)
+/*
+ * Schema
+ *
+ * Settings and columns of a table, without data, as native 32-bit integers
+ * and length-prefixed strings.
+ */
+
+static void table_print_schema_put_int(FILE *f, int value)
 {
-	int len;
-	int num_args;
-	char *tmp;
-	va_list args;
-	struct list_t *tokens;
+	fwrite(&value, sizeof(int), 1, f);
+}
 
-	va_start(args, fmt);
-	temp = strdup_printf()
-	va_end(args);
 
-	if (tmp)
-		column_add_str(column, tmp);
-	free(tmp);
+static void table_print_schema_put_str(FILE *f, const char *str)
+{
+	if (!str)
+	{
+		table_print_schema_put_int(f, -1);
+		return;
+	}
+	table_print_schema_put_int(f, strlen(str));
+	fwrite(str, 1, strlen(str), f);
 }
 
 
-void table_print_print_no_borders(struct table_print_t *tp)
+static int table_print_schema_get_int(FILE *f, int *value)
 {
-	int spaces_left;
-	int first = TRUE;
-	int column;
+	return fread(value, sizeof(int), 1, f) == 1;
+}
 
-	if (tp->show_header)
+
+/* Returns FALSE if the file ends. '*str' is NULL for a NULL string. */
+static int table_print_schema_get_str(FILE *f, char **str)
+{
+	int len;
+
+	*str = NULL;
+	if (!table_print_schema_get_int(f, &len))
+		return FALSE;
+	if (len < 0)
+		return TRUE;
+	*str = malloc(len + 1);
+	if (!*str)
+		fatal("%s: out of memory", __FUNCTION__);
+	if (fread(*str, 1, len, f) != (size_t) len)
 	{
-		LIST_FOR_EACH(tp->columns, column)
-		{
-			struct table_print_column_t *col = list_get(tp->columns, column);
+		free(*str);
+		*str = NULL;
+		return FALSE;
+	}
+	(*str)[len] = '\0';
+	return TRUE;
+}
 
-			if (first)
-			{
-				spaces_left = tp->spaces_left;
-				first = FALSE;
-			}
-			else
-				spaces_left = tp->spaces_between;
 
-			if (col->caption_align == table_print_align_left)
-				fprintf (tp->fout, "%*s%-*s", spaces_left, "", col->max_width, col->caption);
-			else if (col->caption_align == table_print_align_center)
-				fprintf(tp->fout, "%*s%-*s", spaces_left + (col->max_width - (int) strlen(col->caption)) / 2, "", col->max_width - (col->max_width - (int) strlen(col->caption)) / 2, col->caption);
-			else
-				fprintf (tp->fout, "%*s%*s", spaces_left, "", col->max_width, col->caption);
+void table_print_schema_write(struct table_print_t *tp, FILE *f)
+{
+	table_print_schema_put_int(f, tp->show_borders);
+	table_print_schema_put_int(f, tp->show_header);
+	table_print_schema_put_int(f, tp->spaces_left);
+	table_print_schema_put_int(f, tp->spaces_between);
+	table_print_schema_put_int(f, tp->width_limit);
+	table_print_schema_put_int(f, tp->overflow);
+	table_print_schema_put_str(f, tp->double_fmt);
+	table_print_schema_put_str(f, tp->int32_fmt);
 
-			int count = list_count(col->data);
-			if (tp->rows < count)
-				tp->rows = count;
+	table_print_schema_put_int(f, linked_list_count(tp->columns));
+	LINKED_LIST_FOR_EACH(tp->columns)
+	{
+		struct table_print_column_t *col = linked_list_get(tp->columns);
 
-		}
-		fprintf(tp->fout, "\n");
+		table_print_schema_put_str(f, col->caption);
+		table_print_schema_put_int(f, col->caption_align);
+		table_print_schema_put_int(f, col->data_align);
+		table_print_schema_put_int(f, col->encoding);
+		table_print_schema_put_int(f, col->own_width_limit ? col->width_limit : 0);
+		table_print_schema_put_int(f, col->overflow);
+		table_print_schema_put_int(f, col->time ? col->time->nanoseconds : 0);
+		table_print_schema_put_str(f, col->time ? col->time->fmt : NULL);
 	}
-	else
+}
+
+
+struct table_print_t *table_print_schema_read(FILE *f, FILE *fout)
+{
+	struct table_print_t *tp;
+	int settings[6];
+	char *double_fmt;
+	char *int32_fmt;
+	int num_columns;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		if (!table_print_schema_get_int(f, &settings[i]))
+			return NULL;
+	if (!table_print_schema_get_str(f, &double_fmt))
+		return NULL;
+	if (!table_print_schema_get_str(f, &int32_fmt))
 	{
-		LIST_FOR_EACH(tp->columns, column)
-		{
-			struct table_print_column_t *col = list_get(tp->columns, column);
-			int count = list_count(col->data);
-			if (tp->rows < count)
-				tp->rows = count;
-		}
+		free(double_fmt);
+		return NULL;
 	}
 
-	for (int row = 0; row < tp->rows; row++)
+	tp = table_print_create(fout, settings[0], settings[1], settings[2], settings[3]);
+	table_print_set_max_width(tp, settings[4], settings[5]);
+	if (double_fmt)
+		table_print_set_double_fmt(tp, double_fmt);
+	if (int32_fmt)
+		table_print_set_int32_fmt(tp, int32_fmt);
+	free(double_fmt);
+	free(int32_fmt);
+
+	if (!table_print_schema_get_int(f, &num_columns))
 	{
-		first = TRUE;
-		LIST_FOR_EACH(tp->columns, column)
-		{
-			struct table_print_column_t *col = list_get(tp->columns, column);
-			char *cell;
-			cell = list_get(col->data, column);
+		table_print_free(tp);
+		return NULL;
+	}
+	for (i = 0; i < num_columns; i++)
+	{
+		int values[6];
+		char *caption;
+		char *time_fmt = NULL;
+		int j;
 
-			if (first)
+		if (!table_print_schema_get_str(f, &caption))
+		{
+			table_print_free(tp);
+			return NULL;
+		}
+		for (j = 0; j < 6; j++)
+		{
+			if (!table_print_schema_get_int(f, &values[j]))
 			{
-				spaces_left = tp->spaces_left;
-				first = FALSE;
+				free(caption);
+				table_print_free(tp);
+				return NULL;
 			}
-			else
-				spaces_left = tp->spaces_between;
-
-			if (col->data_align == table_print_align_left)
-				fprintf(tp->fout, "%*s%-*s", spaces_left, "", col->max_width, cell);
-			else if (col->data_align == table_print_align_center)
-				fprintf(tp->fout, "%*s%-*s", spaces_left + (col->max_width - (int) strlen(cell)) / 2, "", col->max_width - (col->max_width - (int) strlen(cell)) / 2, cell);
-			else
-				fprintf(tp->fout, "%*s%*s", spaces_left, "", col->max_width, cell);
 		}
-		fprintf(tp->fout, "\n");
+		if (!table_print_schema_get_str(f, &time_fmt))
+		{
+			free(caption);
+			table_print_free(tp);
+			return NULL;
+		}
+
+		table_print_column_add(tp, caption, values[0], values[1]);
+		table_print_column_set_encoding(tp, i, values[2]);
+		if (values[3])
+			table_print_column_set_max_width(tp, i, values[3], values[4]);
+		if (time_fmt)
+			table_print_column_set_time(tp, i, time_fmt, values[5]);
+		free(caption);
+		free(time_fmt);
 	}
+
+	return tp;
 }
 
 
-void table_print_print_with_borders(struct table_print_t *tp)
+/*
+ * Snapshots
+ *
+ * File layout, in native byte order, every section aligned to 8 bytes:
+ *   magic, byte order mark, version
+ *   schema of the table (see table_print_schema_write)
+ *   directory: a table_print_snapshot_column_t per column
+ *   offsets, dictionary codes and string heap of each column
+ * Positions are relative to the start of the file, so the file can be used
+ * where it is mapped.
+ */
+
+#define TABLE_PRINT_SNAPSHOT_MAGIC "TPRNTSNP"
+#define TABLE_PRINT_SNAPSHOT_BOM 0x01020304
+#define TABLE_PRINT_SNAPSHOT_VERSION 2
+
+
+struct table_print_snapshot_column_t
 {
-	int first = TRUE;
-	int spaces_left;
-	int full_width = 0;
-	char *str;
+	unsigned long long count; // rows
+	unsigned long long data_width;
+	unsigned long long num_entries; // dictionary entries, 0 if not dictionary encoded
+	unsigned long long offsets_pos; // count + 1 offsets, or num_entries + 1
+	unsigned long long codes_pos; // count codes if num_entries
+	unsigned long long heap_pos;
+	unsigned long long heap_size;
+};
+
+
+/* Mapping of a loaded table, released with the rows */
+struct table_print_snapshot_map_t
+{
+	void *addr;
+	size_t size;
+};
+
+
+static void table_print_snapshot_align(FILE *f)
+{
+	static const char zeros[8];
+	long pos = ftell(f);
+
+	if (pos % 8)
+		fwrite(zeros, 1, 8 - pos % 8, f);
+}
+
+
+/* Write the offsets of the cells of column 'col', then their strings */
+static void table_print_snapshot_write_cells(struct table_print_t *tp, int col,
+		struct table_print_snapshot_column_t *dir, FILE *f)
+{
+	struct table_print_merge_src_t ms;
+	unsigned long long offset = 0;
+	const char *str;
+	int len;
+
+	table_print_snapshot_align(f);
+	dir->offsets_pos = ftell(f);
+	fwrite(&offset, sizeof(offset), 1, f);
+	for (table_print_merge_src_init(&ms, tp); ms.row < ms.rows; table_print_merge_src_next(&ms))
+	{
+		str = table_print_merge_src_cell(&ms, col, &len);
+		if (len > (int) dir->data_width)
+			dir->data_width = len;
+		offset += len;
+		fwrite(&offset, sizeof(offset), 1, f);
+	}
+
+	dir->heap_pos = ftell(f);
+	dir->heap_size = offset;
+	for (table_print_merge_src_init(&ms, tp); ms.row < ms.rows; table_print_merge_src_next(&ms))
+	{
+		str = table_print_merge_src_cell(&ms, col, &len);
+		fwrite(str, 1, len, f);
+	}
+}
+
+
+/* Write the codes of dictionary encoded column 'col', then its entries */
+static void table_print_snapshot_write_dict(struct table_print_t *tp, int col,
+		struct table_print_snapshot_column_t *dir, FILE *f)
+{
+	struct table_print_column_t *c = table_print_column_get(tp, col);
+	struct table_print_merge_src_t ms;
+	unsigned long long offset = 0;
+	int empty;
 	int i;
 
-	if (tp->show_borders)
+	/* Rows past the end of the column, and spilled rows, are looked up. The
+	 * table is left as it is: a missing empty entry is added to the file
+	 * only, after the others. */
+	empty = table_print_dict_find(c->dict, "", 0, table_print_dict_hash("", 0));
+	if (empty < 0)
+		empty = c->dict->count;
+
+	table_print_snapshot_align(f);
+	dir->codes_pos = ftell(f);
+	for (table_print_merge_src_init(&ms, tp); ms.row < ms.rows; table_print_merge_src_next(&ms))
 	{
-		LIST_FOR_EACH(tp->columns, column)
+		unsigned int code = empty;
+
+		if (ms.row < tp->spilled_rows && tp->spill_cells[col].len)
 		{
-			struct table_print_column_t *col = list_get(tp->columns, column);
-			full_width += (col->max_width + tp->spaces_between);
+			int found = table_print_dict_find(c->dict, tp->spill_cells[col].str, tp->spill_cells[col].len,
+					table_print_dict_hash(tp->spill_cells[col].str, tp->spill_cells[col].len));
+
+			/* Dictionaries keep the entries of spilled rows */
+			if (found < 0)
+				fatal("%s: spilled cell of column %d is not in its dictionary", __FUNCTION__, col);
+			code = found;
 		}
+		else if (ms.row >= tp->spilled_rows && ms.row < c->count)
+			code = table_print_column_code(c, ms.row);
+		fwrite(&code, sizeof(code), 1, f);
 	}
 
-	full_width += list_count(tp->columns);
-	full_width -= 1;
+	table_print_snapshot_align(f);
+	dir->num_entries = c->dict->count + (empty == c->dict->count);
+	dir->offsets_pos = ftell(f);
+	fwrite(&offset, sizeof(offset), 1, f);
+	for (i = 0; i < c->dict->count; i++)
+	{
+		offset += c->dict->entries[i].len;
+		fwrite(&offset, sizeof(offset), 1, f);
+	}
+	if (empty == c->dict->count)
+		fwrite(&offset, sizeof(offset), 1, f);
 
-	if (tp->show_header)
+	dir->heap_pos = ftell(f);
+	dir->heap_size = offset;
+	for (i = 0; i < c->dict->count; i++)
+		fwrite(c->dict->entries[i].str, 1, c->dict->entries[i].len, f);
+	dir->data_width = c->data_width;
+}
+
+
+int table_print_save(struct table_print_t *tp, const char *path)
+{
+	struct table_print_snapshot_column_t *dir;
+	int num_columns = linked_list_count(tp->columns);
+	long dir_pos;
+	FILE *f;
+	int i;
+
+	f = fopen(path, "wb");
+	if (!f)
 	{
-		str = calloc(full_width + 1, sizeof(char));
-		for (i = 0; i < full_width; i++)
-			str[i] = '=';
-		str[i] = '\0';
+		warning("%s: cannot create %s", __FUNCTION__, path);
+		return FALSE;
+	}
+	dir = table_print_mem_calloc(&tp->allocator, num_columns + 1, sizeof(struct table_print_snapshot_column_t));
+	if (!dir)
+		fatal("%s: out of memory", __FUNCTION__);
 
-		fprintf(tp->fout, "%*s%s\n", tp->spaces_left + 1, "", str);
-		free(str);
+	fwrite(TABLE_PRINT_SNAPSHOT_MAGIC, 1, 8, f);
+	i = TABLE_PRINT_SNAPSHOT_BOM;
+	fwrite(&i, sizeof(int), 1, f);
+	i = TABLE_PRINT_SNAPSHOT_VERSION;
+	fwrite(&i, sizeof(int), 1, f);
+	table_print_schema_write(tp, f);
 
-		fprintf(tp->fout, "%*s", tp->spaces_left, "");
-		LIST_FOR_EACH(tp->columns)
-		{
-			struct table_print_column_t *col = list_get(tp->columns);
-			int count;
+	/* The directory is written again once the positions are known */
+	table_print_snapshot_align(f);
+	dir_pos = ftell(f);
+	fwrite(dir, sizeof(struct table_print_snapshot_column_t), num_columns, f);
+
+	table_print_count_rows(tp);
+	for (i = 0; i < num_columns; i++)
+	{
+		struct table_print_column_t *col = table_print_column_get(tp, i);
 
-			if (first)
-				first = FALSE;
-			spaces_left = tp->spaces_between;
+		dir[i].count = tp->rows;
+		if (col->encoding == table_print_encoding_dict && !col->map_heap)
+			table_print_snapshot_write_dict(tp, i, &dir[i], f);
+		else
+			table_print_snapshot_write_cells(tp, i, &dir[i], f);
+	}
 
-			if (col->caption_align == table_print_align_left)
-				fprintf(tp->fout, "|%*s%-*s%*s", spaces_left / 2, "", col->max_width, col->caption, spaces_left / 2, "");
-			else if (col->caption_align == table_print_align_center)
-				fprintf(tp->fout, "|%*s%s%*s", spaces_left / 2 +
-						(col->max_width - (int) strlen(col->caption)) / 2, "",
-						col->caption, col->max_width - (int) strlen (col->caption) -
-						(col->max_width - (int) strlen(col->caption)) / 2 + spaces_left / 2, "");
-			else
-				fprintf (tp->fout, "|%*s%*s%*s", spaces_left / 2, "", col->max_width, col->caption, spaces_left / 2, "");
+	fseek(f, dir_pos, SEEK_SET);
+	fwrite(dir, sizeof(struct table_print_snapshot_column_t), num_columns, f);
+	table_print_mem_free(&tp->allocator, dir);
 
-			count = list_count(col->data);
-			if (tp->rows < count)
-				tp->rows = count;
-		}
-		fprintf(tp->fout, "|\n");
+	if (ferror(f))
+	{
+		warning("%s: cannot write %s", __FUNCTION__, path);
+		fclose(f);
+		return FALSE;
 	}
-	else
+	if (fclose(f))
 	{
-		LIST_FOR_EACH(tp->columns)
-		{
-			struct table_print_column_t *col = list_get(tp->columns);
-			int count = list_count(col->data);
-			if (tp->rows < count)
-				tp->rows = count;
-		}
+		warning("%s: cannot write %s", __FUNCTION__, path);
+		return FALSE;
 	}
+	return TRUE;
+}
 
-	str = calloc(full_width + 1, sizeof(char));
-	for (i = 0; i < full_width; i++)
-		str[i] = '=';
-	str[i] = '\0';
 
-	fprintf(tp->fout, "%*s%s\n", tp->spaces_left + 1, "", str);
-	free(str);
+static void table_print_snapshot_unmap(void *data)
+{
+	struct table_print_snapshot_map_t *map = data;
 
-	for (int row = 0; row < tp->rows; row++) {
-		first = TRUE;
-		fprintf(tp->fout, "%*s", tp->spaces_left, "");
-		LIST_FOR_EACH(tp->columns)
-		{
-			struct table_print_column_t *col = list_get(tp->columns);
-			char *cell;
-			list_goto(col->data, row);
-			cell = list_get(col->data);
+	munmap(map->addr, map->size);
+	free(map);
+}
 
-			if (first)
-				first = FALSE;
 
-			spaces_left = tp->spaces_between;
+/* A section of 'size' bytes at 'pos' is inside a mapping of 'map_size' bytes */
+static int table_print_snapshot_inside(unsigned long long pos, unsigned long long size, size_t map_size)
+{
+	return pos <= map_size && size <= map_size - pos;
+}
 
-			if (col->data_align == table_print_align_left)
-				fprintf(tp->fout, "|%*s%-*s%*s",
-						spaces_left / 2, "",
-						col->max_width, cell,
-						spaces_left / 2, ""
-					   );
-			else if (col->data_align == table_print_align_center)
-				fprintf(tp->fout, "|%*s%s%*s",
-						spaces_left / 2 +  (col->max_width - (int) strlen (cell)) / 2, "", cell,
-						col->max_width - (int) strlen(cell) - (col->max_width - (int) strlen(cell)) / 2 + spaces_left / 2, ""
-					   );
-			else
-				fprintf(tp->fout, "|%*s%*s%*s",
-						spaces_left / 2, "",
-						col->max_width, cell,
-						spaces_left / 2, ""
-					   );
-		}
-		fprintf(tp->fout, "|\n");
+
+struct table_print_t *table_print_load_mmap(const char *path, FILE *fout)
+{
+	struct table_print_snapshot_column_t *dir;
+	struct table_print_snapshot_map_t *map;
+	struct table_print_t *tp;
+	struct stat st;
+	const char *base;
+	int header[2];
+	long pos;
+	FILE *f;
+	int fd;
+	int i;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		warning("%s: cannot open %s", __FUNCTION__, path);
+		return NULL;
+	}
+	if (fstat(fd, &st) || st.st_size < 16)
+	{
+		warning("%s: %s is not a table snapshot", __FUNCTION__, path);
+		close(fd);
+		return NULL;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		warning("%s: cannot map %s", __FUNCTION__, path);
+		return NULL;
+	}
+
+	memcpy(header, base + 8, sizeof(header));
+	if (memcmp(base, TABLE_PRINT_SNAPSHOT_MAGIC, 8) || header[0] != TABLE_PRINT_SNAPSHOT_BOM ||
+			header[1] != TABLE_PRINT_SNAPSHOT_VERSION)
+	{
+		warning("%s: %s is not a table snapshot of this version and byte order", __FUNCTION__, path);
+		munmap((void *) base, st.st_size);
+		return NULL;
 	}
 
-	str = calloc(full_width + 1, sizeof(char));
-	for (i = 0; i < full_width; i++)
-		str[i] = '=';
-	str[i] = '\0';
+	/* The schema is small, it is read like the one of a log */
+	f = fmemopen((void *) base, st.st_size, "r");
+	if (!f)
+		fatal("%s: out of memory", __FUNCTION__);
+	fseek(f, 16, SEEK_SET);
+	tp = table_print_schema_read(f, fout);
+	pos = ftell(f);
+	fclose(f);
+	pos = (pos + 7) / 8 * 8;
+	if (!tp || !table_print_snapshot_inside(pos, (unsigned long long) linked_list_count(tp->columns) *
+			sizeof(struct table_print_snapshot_column_t), st.st_size))
+	{
+		warning("%s: truncated table snapshot %s", __FUNCTION__, path);
+		if (tp)
+			table_print_free(tp);
+		munmap((void *) base, st.st_size);
+		return NULL;
+	}
 
-	fprintf(tp->fout, "%*s%s\n", tp->spaces_left + 1, "", str);
-	free(str);
-}
+	/* Columns point into the mapping, nothing is copied */
+	dir = (struct table_print_snapshot_column_t *) (base + pos);
+	for (i = 0; i < linked_list_count(tp->columns); i++)
+	{
+		struct table_print_column_t *col = table_print_column_get(tp, i);
+		unsigned long long offsets = dir[i].num_entries ? dir[i].num_entries : dir[i].count;
+		const unsigned long long *last;
+
+		if (dir[i].count > (-1U >> 1) || offsets > (-1U >> 1) ||
+				!table_print_snapshot_inside(dir[i].offsets_pos, (offsets + 1) * sizeof(unsigned long long), st.st_size) ||
+				(dir[i].num_entries && !table_print_snapshot_inside(dir[i].codes_pos,
+						dir[i].count * sizeof(unsigned int), st.st_size)) ||
+				!table_print_snapshot_inside(dir[i].heap_pos, dir[i].heap_size, st.st_size) ||
+				dir[i].offsets_pos % 8 || dir[i].codes_pos % 4)
+		{
+			warning("%s: corrupt table snapshot %s", __FUNCTION__, path);
+			table_print_free(tp);
+			munmap((void *) base, st.st_size);
+			return NULL;
+		}
+		last = (const unsigned long long *) (base + dir[i].offsets_pos) + offsets;
+		if (*last > dir[i].heap_size)
+		{
+			warning("%s: corrupt table snapshot %s", __FUNCTION__, path);
+			table_print_free(tp);
+			munmap((void *) base, st.st_size);
+			return NULL;
+		}
 
+		/* Read as plain strings whatever the encoding was */
+		table_print_column_set_encoding(tp, i, table_print_encoding_plain);
+		col->count = dir[i].count;
+		col->map_heap = base + dir[i].heap_pos;
+		col->map_offsets = (const unsigned long long *) (base + dir[i].offsets_pos);
+		col->map_codes = dir[i].num_entries ? (const unsigned int *) (base + dir[i].codes_pos) : NULL;
+		col->data_width = dir[i].data_width;
+		table_print_column_update_width(col);
+	}
 
-void table_print_print(struct table_print_t *tp)
-{
-	if (tp->show_borders)
-		table_print_print_with_borders(tp);
-	else
-		table_print_print_no_borders(tp);
+	map = malloc(sizeof(struct table_print_snapshot_map_t));
+	if (!map)
+		fatal("%s: out of memory", __FUNCTION__);
+	map->addr = (void *) base;
+	map->size = st.st_size;
+	table_print_add_release(tp, table_print_snapshot_unmap, map);
+	tp->map = map;
+	return tp;
 }
@@ -20,6 +20,8 @@
 #ifndef TABLE_PRINT_H
 #define TABLE_PRINT_H
 
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 
 
@@ -30,6 +32,11 @@
 #define FALSE 0
 #endif
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct table_print_t;
 
 enum table_print_align_t
 {
@@ -38,6 +45,58 @@ enum table_print_align_t
     table_print_align_right,
 };
 
+// what to do with cells wider than the maximum width of their column
+enum table_print_overflow_t
+{
+    table_print_overflow_truncate = 0, // cut the cell
+    table_print_overflow_ellipsis, // cut the cell and end it with "..."
+    table_print_overflow_wrap, // continue the cell in the following lines
+};
+
+enum table_print_encoding_t
+{
+    table_print_encoding_plain = 0,
+    table_print_encoding_dict,
+    table_print_encoding_delta,
+};
+
+// unit of the values of a time column
+enum table_print_time_unit_t
+{
+    table_print_time_seconds = 0,
+    table_print_time_nanoseconds,
+};
+
+// comparison of the cells of a column with the operand of a filter
+enum table_print_cmp_t
+{
+    table_print_cmp_eq = 0,
+    table_print_cmp_ne,
+    table_print_cmp_lt,
+    table_print_cmp_le,
+    table_print_cmp_gt,
+    table_print_cmp_ge,
+    table_print_cmp_prefix, // strings only: the cell starts with the operand
+};
+
+struct table_print_filter_t;
+
+enum table_print_agg_t
+{
+    table_print_agg_count = 0, // rows of the group
+    table_print_agg_sum,
+    table_print_agg_min,
+    table_print_agg_max,
+    table_print_agg_mean,
+};
+
+// aggregate column of table_print_group_by. 'col' is ignored by table_print_agg_count
+struct table_print_aggregate_t
+{
+    int col;
+    enum table_print_agg_t agg;
+};
+
 // create table_print_t object
 // fout: FILE to write table to. Must be opened with write permissions. Can specify stdout / stderr
 // borders: set to TRUE to draw inner and outer borders
@@ -46,15 +105,78 @@ enum table_print_align_t
 // spaces_between: spaces between columns
 struct table_print_t* table_print_create(FILE *fout, int show_borders, int show_header, int spaces_left, int spaces_between);
 
+// Memory functions of a table. 'ctx' is passed to each of them. malloc_func returns NULL when out
+// of memory, and realloc_func and free_func get pointers returned by these functions
+struct table_print_allocator_t
+{
+    void *(*malloc_func)(size_t size, void *ctx);
+    void *(*realloc_func)(void *ptr, size_t size, void *ctx);
+    void (*free_func)(void *ptr, void *ctx);
+    void *ctx;
+};
+
+// Create a table whose memory comes from 'allocator', which is copied: the table itself, its
+// columns, cells, dictionaries and the buffers used to print it, and the logs, directory scans,
+// double buffered snapshots and asynchronous prints of the table. Tables made from this one
+// (table_print_create_like, table_print_group_by) use the same allocator. NULL uses the C library.
+// Filters are made before they are given to a table, so they use the C library, as do the tables
+// read from a log or a snapshot (table_print_log_read, table_print_load_mmap)
+struct table_print_t *table_print_create_with_allocator(FILE *fout, int show_borders, int show_header, int spaces_left,
+        int spaces_between, const struct table_print_allocator_t *allocator);
+
 // destroy table_print_t object
 void table_print_free(struct table_print_t *tp);
 
+// create a table with the same settings and columns as 'tp', but no data
+struct table_print_t *table_print_create_like(struct table_print_t *tp);
+
+// remove all data from the table, keeping its columns
+void table_print_clear(struct table_print_t *tp);
+
 // Append column to the table
 // caption: label of the column, can be NULL
 // caption_align: how to align column caption
 // data_align: how to align data in the column
 void table_print_column_add(struct table_print_t *tp, const char *caption, enum table_print_align_t caption_align, enum table_print_align_t data_align);
 
+// Select how the data of a column is stored. Must be called before adding data to the column
+// table_print_encoding_plain: every cell keeps its own copy of the string (default)
+// table_print_encoding_dict: distinct values are stored once and each row keeps a small code.
+//   Use it for low-cardinality columns (permissions, owners, status strings...)
+// table_print_encoding_delta: integer columns only. Each value is stored as a varint difference with
+//   the previous one, usually a byte or two for timestamps, sequence numbers, offsets... Values are
+//   printed in plain decimal, the int32 format does not apply
+void table_print_column_set_encoding(struct table_print_t *tp, int col, enum table_print_encoding_t encoding);
+
+// Store timestamps in a column and print them with strftime pattern 'fmt', in local time. Values
+// are added with table_print_data_add_uint64 or table_print_data_add_int32 as seconds or
+// nanoseconds since the epoch, and kept delta encoded. Must be called before adding data to the
+// column. The date part of the pattern and the time zone are formatted once per day, and hours,
+// minutes, seconds and AM/PM (%H %I %k %l %M %S %T %R %p %P, and %s) are filled in for each row,
+// so consecutive rows do not call the C library. Other conversions that depend on the time of the
+// day (%c %X %r...) are formatted once per distinct second. %N prints the nanoseconds, %3N the
+// first 3 digits. NULL 'fmt' means "%Y-%m-%d %H:%M:%S". Cells are the formatted text, except for
+// table_print_get_number and filters on numbers, which see the values
+void table_print_column_set_time(struct table_print_t *tp, int col, const char *fmt, enum table_print_time_unit_t unit);
+
+// Limit the width of a column. Longer cells (and caption) are cut according to 'overflow'. Widths
+// are counted in bytes, and cells are cut between UTF-8 characters
+// max_width: maximum width in bytes, 0 to fall back to the table limit
+void table_print_column_set_max_width(struct table_print_t *tp, int col, int max_width, enum table_print_overflow_t overflow);
+
+// Limit the width of every column that has no limit of its own, 0 to remove the limit
+void table_print_set_max_width(struct table_print_t *tp, int max_width, enum table_print_overflow_t overflow);
+
+// Keep at most about 'bytes' of cell data in memory. Past the budget, complete blocks of rows
+// are moved to a temporary file and streamed back by table_print_print. 0 means no limit
+void table_print_set_memory_budget(struct table_print_t *tp, size_t bytes);
+
+// Keep only the last 'rows' rows, printed oldest first. Each new row overwrites the oldest one,
+// and column widths shrink when the widest cells are overwritten. The memory of the rows is
+// allocated here. Must be called before any data is added; not available with delta encoding or
+// a memory budget. Dictionaries keep the entries of overwritten rows. 0 means no limit
+void table_print_set_ring(struct table_print_t *tp, int rows);
+
 // set table format for double numbers
 void table_print_set_double_fmt(struct table_print_t *tp, const char *fmt);
 
@@ -66,9 +188,206 @@ void table_print_data_add_uint64(struct table_print_t *tp, int col, unsigned lon
 void table_print_data_add_str(struct table_print_t *tp, int col, const char *data);
 void table_print_data_add_double(struct table_print_t *tp, int col, double data);
 
+// Add a cell that refers to 'len' bytes at 'data' instead of copying them. The bytes must stay
+// valid and unchanged until the table is cleared or freed. Dictionary encoded columns still keep
+// their own copy of each distinct value
+void table_print_data_add_str_ref(struct table_print_t *tp, int col, const char *data, int len);
+
+// Add 'n' borrowed cells, as table_print_data_add_str_ref. 'len' can be NULL for null terminated strings
+void table_print_data_add_str_ref_array(struct table_print_t *tp, int col, const char *const *data, const int *len, int n);
+
+// Add 'n' numbers to a column. Numbers are converted as they are added, so 'data' is not borrowed
+void table_print_data_add_int32_array(struct table_print_t *tp, int col, const int *data, int n);
+void table_print_data_add_uint64_array(struct table_print_t *tp, int col, const unsigned long long *data, int n);
+void table_print_data_add_double_array(struct table_print_t *tp, int col, const double *data, int n);
+
+// Edit rows in place. Column widths stay exact: each column counts the widths of its cells once it
+// is first edited, so a cell that stops being the widest one narrows the column. Editing a cell
+// costs about the same as adding one, whatever the size of the table. Not available with a memory
+// budget or on a table loaded from a snapshot; virtual columns are made again instead.
+// Set the cell in 'row' to a copy of 'data'. Delta encoded columns take the digits of an integer.
+// Rows past the end of the column are added, the ones in between being empty. On a ring buffer,
+// 'row' must be one of the rows it holds
+void table_print_set_cell(struct table_print_t *tp, int col, int row, const char *data);
+// Remove 'row' from every column that has it. Rows below move up. Not available on a ring buffer
+void table_print_delete_row(struct table_print_t *tp, int row);
+// Insert an empty row before 'row' (0 in delta encoded columns), in every column that holds at
+// least 'row' rows. Not available on a ring buffer
+void table_print_insert_row(struct table_print_t *tp, int row);
+
+// called once a table no longer refers to borrowed data
+typedef void (*table_print_release_func_t)(void *data);
+
+// Call 'func' with 'data' when the table is next cleared or freed, after which it does not refer to
+// any borrowed cell. Functions are called in the order they were added
+void table_print_add_release(struct table_print_t *tp, table_print_release_func_t func, void *data);
+
+// Makes the cell of a virtual column in 'row': writes at most 'size' bytes (no null needed) to 'buf'
+// and returns the length of the cell. If the length is 'size' or more, the callback is called again
+// with a larger buffer, as with snprintf
+typedef int (*table_print_virtual_func_t)(struct table_print_t *tp, int row, char *buf, int size, void *data);
+
+// Append a column whose cells are made by 'func' instead of being added. Cells are only made for
+// the rows being printed, when the table is printed, and kept for later prints until the data of
+// the table changes. Filters on a virtual column, group by, merges and snapshots make every row.
+// Callbacks read the other cells of the row with table_print_get_cell and table_print_get_number,
+// including virtual columns on the left
+void table_print_column_add_virtual(struct table_print_t *tp, const char *caption, enum table_print_align_t caption_align,
+        enum table_print_align_t data_align, table_print_virtual_func_t func, void *data);
+
+// Cell of column 'col' in 'row', not null terminated; its length goes to 'len'. Rows moved to the
+// spill file can only be read from the callback of a virtual column
+const char *table_print_get_cell(struct table_print_t *tp, int col, int row, int *len);
+
+// Cell of column 'col' in 'row' as a number. Returns FALSE if it does not hold one
+int table_print_get_number(struct table_print_t *tp, int col, int row, double *value);
+
 // output table to the specified FILE
 void table_print_print(struct table_print_t *tp);
 
+// Print only columns 'cols' (n of them), in that order. Columns may be repeated. Column widths
+// and borders only depend on the printed columns. No data is copied. Pass NULL to print every column
+void table_print_set_view(struct table_print_t *tp, const int *cols, int n);
+
+// Filters select the rows printed by table_print_print. They are evaluated when printing, over
+// the stored data, and column widths only account for the rows that pass.
+// Numeric comparisons parse the cells as numbers. Cells that are not numbers do not pass them.
+// String comparisons are bytewise.
+struct table_print_filter_t *table_print_filter_number(int col, enum table_print_cmp_t cmp, double value);
+struct table_print_filter_t *table_print_filter_str(int col, enum table_print_cmp_t cmp, const char *str);
+// min <= cell <= max
+struct table_print_filter_t *table_print_filter_range(int col, double min, double max);
+// the combined filter takes ownership of 'left' and 'right'
+struct table_print_filter_t *table_print_filter_and(struct table_print_filter_t *left, struct table_print_filter_t *right);
+struct table_print_filter_t *table_print_filter_or(struct table_print_filter_t *left, struct table_print_filter_t *right);
+// free a filter that was not given to a table
+void table_print_filter_free(struct table_print_filter_t *filter);
+
+// Print only the rows that pass 'filter'. The table takes ownership of it. NULL prints every row
+void table_print_set_filter(struct table_print_t *tp, struct table_print_filter_t *filter);
+
+// Summarize 'src' into a new table with one row per distinct value of the columns 'key_cols'
+// (num_keys of them), in order of first appearance. The new table has the key columns followed
+// by one column per aggregate. Aggregates other than count only take the cells that hold a
+// number. Sum, min and max of delta encoded columns are exact integers, the rest are printed
+// with the double format. Every row of 'src' is summarized, its filter does not apply
+struct table_print_t *table_print_group_by(struct table_print_t *src, const int *key_cols, int num_keys,
+        const struct table_print_aggregate_t *aggs, int num_aggs);
+
+// Append the rows of 'src' to 'dst', which must have as many columns. The blocks of each column
+// are moved, not copied, so the cost depends on the number of blocks rather than rows; dictionary
+// columns only remap their codes. Borrowed cells and their releases move to 'dst' too. Rows are
+// copied instead if either table is a ring buffer, 'dst' has a memory budget, the tables have
+// different allocators, or 'src' has spilled rows or was loaded from a snapshot. 'src' is left empty
+void table_print_merge(struct table_print_t *dst, struct table_print_t *src);
+
+// Append the rows of 'num_srcs' tables, each sorted by column 'key_col', to 'dst' in key order.
+// Keys are compared as numbers if 'numeric' (other keys go last, as strings), as strings
+// otherwise. Equal keys keep the order of the tables. Rows are copied, the sources are left empty
+void table_print_merge_sorted(struct table_print_t *dst, struct table_print_t **srcs, int num_srcs,
+        int key_col, int numeric);
+
+// Binary row log. Hot paths append fixed layout records to a buffered file without formatting
+// anything, and the log is turned into a table later, possibly by another process (tprint-render).
+// The log carries the schema of the table it was created from: settings, captions, alignments,
+// encodings, time and number formats. Logs are written in native byte order.
+enum table_print_type_t
+{
+    table_print_type_int32 = 0, // int, printed with the int32 format
+    table_print_type_uint64, // unsigned long long
+    table_print_type_double, // double, printed with the double format
+    table_print_type_str, // char[size], null terminated unless it fills the field
+};
+
+// field of a log record, one per column
+struct table_print_field_t
+{
+    enum table_print_type_t type;
+    int size; // table_print_type_str only
+};
+
+struct table_print_log_t;
+
+// Write the header of a log to 'f'. Records are laid out like a C struct with the fields in
+// column order, so a struct of int, unsigned long long, double and char arrays can be appended as is
+struct table_print_log_t *table_print_log_create(FILE *f, struct table_print_t *tp,
+        const struct table_print_field_t *fields, int num_fields);
+// flush and free the log. 'f' is not closed
+void table_print_log_free(struct table_print_log_t *log);
+// Append a record of table_print_log_record_size bytes. It is only copied to a buffer, which is
+// written to the file when full. A log must be written by one thread at a time
+void table_print_log_append(struct table_print_log_t *log, const void *record);
+void table_print_log_flush(struct table_print_log_t *log);
+int table_print_log_record_size(struct table_print_log_t *log);
+
+// Read a whole log into a new table that prints to 'fout'. Returns NULL if 'f' does not hold a log
+struct table_print_t *table_print_log_read(FILE *f, FILE *fout);
+
+// Snapshots. table_print_save writes the schema, every row (spilled ones too) and the column
+// widths to 'path', laid out so that the file is used in place. Returns FALSE if the file cannot
+// be written
+int table_print_save(struct table_print_t *tp, const char *path);
+
+// Map a snapshot written by table_print_save into a new table that prints to 'fout'. Cells are
+// read straight from the mapping, shared with other processes loading the same file, so loading
+// takes the same time whatever the size. Encodings are not kept: columns hold plain strings, and
+// delta encoded ones their decimal digits. The table is read-only until table_print_clear, which
+// unmaps the file. Snapshots are trusted: only their layout is checked, not every cell. Returns
+// NULL if 'path' does not hold a snapshot
+struct table_print_t *table_print_load_mmap(const char *path, FILE *fout);
+
+// called by the writer thread once a table given to table_print_print_async has been written
+typedef void (*table_print_done_func_t)(struct table_print_t *tp, void *data);
+
+// Output the table from a background thread and return right away. The table now belongs to the
+// writer thread and must not be touched until 'done' is called with it. If 'done' is NULL the
+// table is freed after printing. Tables are written in the order they are submitted
+void table_print_print_async(struct table_print_t *tp, table_print_done_func_t done, void *data);
+
+// wait until every table given to table_print_print_async has been written
+void table_print_async_wait(void);
+
+// Double buffered table, for producer threads that keep adding rows while another thread prints
+// it periodically. Producers add each row between table_print_snapshot_begin_row and
+// table_print_snapshot_end_row. table_print_snapshot_print swaps buffers, moves the rows completed
+// since the previous call to a read-only view of the whole table, and prints the view, outside of
+// any lock. Producers never wait for the printer, and the printer never sees a partial row.
+struct table_print_snapshot_t;
+
+// 'tp' provides the columns and settings, and becomes one of the two buffers
+struct table_print_snapshot_t *table_print_snapshot_create(struct table_print_t *tp);
+void table_print_snapshot_free(struct table_print_snapshot_t *snap);
+
+// Start a row. Returns the table to add the cells of the row to
+struct table_print_t *table_print_snapshot_begin_row(struct table_print_snapshot_t *snap);
+void table_print_snapshot_end_row(struct table_print_snapshot_t *snap);
+
+// Print every row completed so far. Moving the new rows costs about one step per block, not per
+// row. Only one thread may call it at a time
+void table_print_snapshot_print(struct table_print_snapshot_t *snap);
+
+// fields of table_print_from_directory
+enum table_print_dir_field_t
+{
+    table_print_dir_name = 0, // name of the entry
+    table_print_dir_mode, // type and permissions as printed by ls -l, like "drwxr-xr-x"
+    table_print_dir_uid, // numeric owner
+    table_print_dir_gid, // numeric group
+    table_print_dir_size, // bytes
+    table_print_dir_mtime, // modification time in seconds since the epoch, see table_print_column_set_time
+    table_print_dir_mtime_ns, // modification time in nanoseconds since the epoch
+};
+
+// Add a row per entry of directory 'path' but "." and "..", sorted by name. There must be a field
+// per column: field i goes to column i. Names are borrowed from a buffer that the table releases.
+// Entries are looked up relative to the directory, without following symbolic links, by 'workers'
+// threads (0 for one per CPU) with statx asking only for the fields needed. Lookups wait for the
+// server on network file systems, so more workers than CPUs help there. Entries removed during
+// the scan are left out. Returns the number of rows added, or -1 if the directory cannot be read,
+// with errno set
+int table_print_from_directory(struct table_print_t *tp, const char *path,
+        const enum table_print_dir_field_t *fields, int num_fields, int workers);
+
 
 void table_print_add_row(struct table_print_t *tp, const char* fmt, ...)  __attribute__ ((format (printf, 2, 3)));
 
@@ -77,7 +396,22 @@ void table_print_add_row(struct table_print_t *tp, const char* fmt, ...)  __attr
 /* Private functions */
 
 char* strdup_printf(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+char* strdup_vprintf(const char *fmt, va_list args);
+FILE *table_print_get_fout(struct table_print_t *tp);
+int table_print_get_num_columns(struct table_print_t *tp);
+enum table_print_encoding_t table_print_get_column_encoding(struct table_print_t *tp, int col);
+const struct table_print_allocator_t *table_print_get_allocator(struct table_print_t *tp);
+void *table_print_mem_malloc(const struct table_print_allocator_t *allocator, size_t size);
+void *table_print_mem_calloc(const struct table_print_allocator_t *allocator, size_t count, size_t size);
+void *table_print_mem_realloc(const struct table_print_allocator_t *allocator, void *ptr, size_t size);
+void table_print_mem_free(const struct table_print_allocator_t *allocator, void *ptr);
+void table_print_schema_write(struct table_print_t *tp, FILE *f);
+struct table_print_t *table_print_schema_read(FILE *f, FILE *fout);
 struct table_print_column_t;
 void table_print_column_free(struct table_print_column_t *col);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,475 @@
+/*
+ * Table Print utilities
+ * Copyright (C) 2012-2013 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2013 Vicent Selfa <vtselfa@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#ifndef TABLE_PRINT_HPP
+#define TABLE_PRINT_HPP
+
+// C++ wrapper with the column schema in the type of the table
+//
+//   tprint::table<tprint::column<const char *>,
+//                 tprint::column<double, tprint::align::right>,
+//                 tprint::column<int, tprint::align::center> > t(stdout, {"Name", "Load", "Jobs"});
+//   t.add_row("host1", 0.75, 12);
+//   t.print();
+//
+// add_row() is checked at compile time: wrong number of values, or values
+// that do not convert to the column type without narrowing, do not compile.
+// Each value goes straight to the matching table_print_data_add_* call.
+//
+// For fixed-format lines that are printed over and over (periodic stats...),
+// tprint::layout fixes widths, alignments and borders at compile time and
+// emits rows without going through a table_print_t:
+//
+//   typedef tprint::layout<tprint::border::ascii, 0, 2,
+//                          tprint::field<12>,
+//                          tprint::field<8, tprint::align::right>,
+//                          tprint::field<10, tprint::align::right, 2> > stats;
+//   stats::print_border(stderr);
+//   stats::print_row(stderr, "requests", 1234, 0.98);
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "table-print.h"
+
+
+namespace tprint
+{
+
+enum class align
+{
+    left = table_print_align_left,
+    center = table_print_align_center,
+    right = table_print_align_right,
+};
+
+// Column of the schema
+// T: int, unsigned long long (uint64_t), double, const char * or std::string
+// Data: how to align the data
+// Caption: how to align the caption
+template <typename T, align Data = align::left, align Caption = align::center>
+struct column
+{
+    typedef T type;
+    static constexpr align data_align = Data;
+    static constexpr align caption_align = Caption;
+};
+
+
+namespace detail
+{
+
+// Typed storage of each column type
+template <typename T> struct storage;
+
+template <> struct storage<int>
+{
+    static void add(struct table_print_t *tp, int col, int data)
+    {
+        table_print_data_add_int32(tp, col, data);
+    }
+};
+
+template <> struct storage<unsigned long long>
+{
+    static void add(struct table_print_t *tp, int col, unsigned long long data)
+    {
+        table_print_data_add_uint64(tp, col, data);
+    }
+};
+
+template <> struct storage<unsigned long> : storage<unsigned long long> { };
+
+template <> struct storage<double>
+{
+    static void add(struct table_print_t *tp, int col, double data)
+    {
+        table_print_data_add_double(tp, col, data);
+    }
+};
+
+template <> struct storage<const char *>
+{
+    static void add(struct table_print_t *tp, int col, const char *data)
+    {
+        table_print_data_add_str(tp, col, data);
+    }
+
+    static void add(struct table_print_t *tp, int col, const std::string &data)
+    {
+        table_print_data_add_str(tp, col, data.c_str());
+    }
+};
+
+template <> struct storage<std::string> : storage<const char *> { };
+
+
+// Whether a value of type 'From' can be stored in a column of type 'To'.
+// Integer columns take integers that fit: smaller types of the same
+// signedness, smaller unsigned types, or types of the same size and
+// signedness. Signed values never go to unsigned columns, -1 included.
+template <typename To, typename From, typename F = typename std::decay<From>::type>
+struct converts
+    : std::integral_constant<bool, std::is_integral<F>::value && !std::is_same<F, bool>::value &&
+        (std::is_signed<F>::value == std::is_signed<To>::value || std::is_unsigned<F>::value) &&
+        (sizeof(F) < sizeof(To) || (sizeof(F) == sizeof(To) && std::is_signed<F>::value == std::is_signed<To>::value))> { };
+
+// Double columns take float and double, and integers of up to 53 bits,
+// which a double holds exactly.
+template <typename From, typename F>
+struct converts<double, From, F>
+    : std::integral_constant<bool, std::is_same<F, float>::value || std::is_same<F, double>::value ||
+        (std::is_integral<F>::value && !std::is_same<F, bool>::value &&
+         std::numeric_limits<F>::digits <= std::numeric_limits<double>::digits)> { };
+
+template <typename From, typename F>
+struct converts<std::string, From, F>
+    : std::integral_constant<bool, std::is_convertible<From, const char *>::value ||
+        std::is_convertible<From, const std::string &>::value> { };
+
+template <typename From, typename F>
+struct converts<const char *, From, F> : converts<std::string, From, F> { };
+
+
+template <size_t I, typename... Cols>
+struct add_cells
+{
+    static void add(struct table_print_t *) { }
+};
+
+template <size_t I, typename Col, typename... Cols>
+struct add_cells<I, Col, Cols...>
+{
+    template <typename Arg, typename... Args>
+    static void add(struct table_print_t *tp, Arg &&arg, Args &&... args)
+    {
+        typedef typename Col::type type;
+
+        static_assert(converts<type, Arg>::value,
+                "tprint::table::add_row: value does not match the column type");
+        storage<type>::add(tp, I, std::forward<Arg>(arg));
+        add_cells<I + 1, Cols...>::add(tp, std::forward<Args>(args)...);
+    }
+};
+
+} // namespace detail
+
+
+template <typename... Cols>
+class table
+{
+public:
+    static constexpr size_t num_columns = sizeof...(Cols);
+
+    // See table_print_create()
+    table(FILE *fout, const char *const (&captions)[sizeof...(Cols)],
+            bool show_borders = true, bool show_header = true,
+            int spaces_left = 0, int spaces_between = 2)
+        : tp(table_print_create(fout, show_borders, show_header, spaces_left, spaces_between))
+    {
+        static const align caption_aligns[] = { Cols::caption_align... };
+        static const align data_aligns[] = { Cols::data_align... };
+
+        for (size_t i = 0; i < num_columns; i++)
+            table_print_column_add(tp, captions[i],
+                    static_cast<enum table_print_align_t>(caption_aligns[i]),
+                    static_cast<enum table_print_align_t>(data_aligns[i]));
+    }
+
+    ~table()
+    {
+        table_print_free(tp);
+    }
+
+    table(const table &) = delete;
+    table &operator=(const table &) = delete;
+
+    template <typename... Args>
+    void add_row(Args &&... args)
+    {
+        static_assert(sizeof...(Args) == num_columns,
+                "tprint::table::add_row: the number of values does not match the number of columns");
+        detail::add_cells<0, Cols...>::add(tp, std::forward<Args>(args)...);
+    }
+
+    void print()
+    {
+        table_print_print(tp);
+    }
+
+    // Underlying table, for the rest of the C API
+    struct table_print_t *get()
+    {
+        return tp;
+    }
+
+private:
+    struct table_print_t *tp;
+};
+
+
+enum class border
+{
+    none, // fields separated by spaces
+    ascii, // same borders as table_print_create(..., show_borders = TRUE, ...)
+};
+
+// Field of a fixed layout
+// Width: width of the field in characters. Longer values are truncated
+// Align: how to align the value
+// Precision: digits after the decimal point for floating point values
+template <size_t Width, align Align = align::left, int Precision = 3>
+struct field
+{
+    static constexpr size_t width = Width;
+    static constexpr align alignment = Align;
+    static constexpr int precision = Precision;
+};
+
+
+namespace detail
+{
+
+constexpr size_t sum_first(size_t)
+{
+    return 0;
+}
+
+// Sum of the first 'n' values
+template <typename... T>
+constexpr size_t sum_first(size_t n, size_t value, T... values)
+{
+    return n == 0 ? 0 : value + sum_first(n - 1, values...);
+}
+
+
+// Copy 'len' bytes of 'str' into a field already filled with spaces
+template <size_t Width, align Align>
+inline void place(char *field, const char *str, size_t len)
+{
+    if (len > Width)
+        len = Width;
+    if (Align == align::left)
+        memcpy(field, str, len);
+    else if (Align == align::center)
+        memcpy(field + (Width - len) / 2, str, len);
+    else
+        memcpy(field + Width - len, str, len);
+}
+
+template <typename Field>
+inline void place_value(char *field, const char *str)
+{
+    place<Field::width, Field::alignment>(field, str, strlen(str));
+}
+
+template <typename Field>
+inline void place_value(char *field, const std::string &str)
+{
+    place<Field::width, Field::alignment>(field, str.data(), str.size());
+}
+
+template <typename Field>
+inline void place_value(char *field, unsigned long long value, bool negative = false)
+{
+    char buf[24];
+    char *p = buf + sizeof(buf);
+
+    do
+    {
+        *--p = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    if (negative)
+        *--p = '-';
+    place<Field::width, Field::alignment>(field, p, buf + sizeof(buf) - p);
+}
+
+template <typename Field>
+inline void place_value(char *field, long long value)
+{
+    if (value < 0)
+        place_value<Field>(field, 0ull - (unsigned long long) value, true);
+    else
+        place_value<Field>(field, (unsigned long long) value);
+}
+
+template <typename Field>
+inline void place_value(char *field, int value)
+{
+    place_value<Field>(field, (long long) value);
+}
+
+template <typename Field>
+inline void place_value(char *field, long value)
+{
+    place_value<Field>(field, (long long) value);
+}
+
+template <typename Field>
+inline void place_value(char *field, unsigned value)
+{
+    place_value<Field>(field, (unsigned long long) value);
+}
+
+template <typename Field>
+inline void place_value(char *field, unsigned long value)
+{
+    place_value<Field>(field, (unsigned long long) value);
+}
+
+template <typename Field>
+inline void place_value(char *field, double value)
+{
+    char buf[64];
+    int len;
+
+    len = snprintf(buf, sizeof(buf), "%.*f", Field::precision, value);
+    if (len >= (int) sizeof(buf))
+        len = sizeof(buf) - 1;
+    place<Field::width, Field::alignment>(field, buf, len);
+}
+
+
+template <size_t I, typename Layout, typename... Fields>
+struct place_fields
+{
+    static void place(char *) { }
+};
+
+template <size_t I, typename Layout, typename Field, typename... Fields>
+struct place_fields<I, Layout, Field, Fields...>
+{
+    template <typename Arg, typename... Args>
+    static void place(char *line, const Arg &arg, const Args &... args)
+    {
+        place_value<Field>(line + Layout::template offset<I>(), arg);
+        place_fields<I + 1, Layout, Fields...>::place(line, args...);
+    }
+};
+
+} // namespace detail
+
+
+// Layout known at compile time
+// Border: border style
+// SpacesLeft: spaces on the left side of the table
+// SpacesBetween: spaces between columns
+// Fields: tprint::field of each column
+template <border Border, size_t SpacesLeft, size_t SpacesBetween, typename... Fields>
+class layout
+{
+    typedef layout<Border, SpacesLeft, SpacesBetween, Fields...> self;
+
+    static constexpr size_t num_fields = sizeof...(Fields);
+    static constexpr size_t half = SpacesBetween / 2;
+
+    // Characters before the first field, and between the start of two fields
+    static constexpr size_t lead = Border == border::ascii ? 1 + half : 0;
+    static constexpr size_t step = Border == border::ascii ? 1 + 2 * half : SpacesBetween;
+
+public:
+    static constexpr size_t data_width = detail::sum_first(num_fields, Fields::width...);
+
+    // Length of a row, including the newline
+    static constexpr size_t line_len = Border == border::ascii ?
+        SpacesLeft + data_width + num_fields * step + 2 :
+        SpacesLeft + data_width + (num_fields ? num_fields - 1 : 0) * step + 1;
+
+    // Offset of field I inside a row
+    template <size_t I>
+    static constexpr size_t offset()
+    {
+        return SpacesLeft + lead + detail::sum_first(I, Fields::width...) + I * step;
+    }
+
+    // Print one row. Takes one value per field: strings, integers or doubles
+    template <typename... Args>
+    static void print_row(FILE *fout, const Args &... args)
+    {
+        static_assert(sizeof...(Args) == num_fields,
+                "tprint::layout::print_row: the number of values does not match the number of fields");
+        char line[line_len];
+
+        memcpy(line, templates().row, line_len);
+        detail::place_fields<0, self, Fields...>::place(line, args...);
+        fwrite(line, 1, line_len, fout);
+    }
+
+    // Print a row of captions
+    template <typename... Args>
+    static void print_header(FILE *fout, const Args &... captions)
+    {
+        print_row(fout, captions...);
+    }
+
+    // Print a horizontal border. Does nothing with border::none
+    static void print_border(FILE *fout)
+    {
+        if (Border == border::ascii)
+            fwrite(templates().border, 1, border_len, fout);
+    }
+
+private:
+    static constexpr size_t border_len = SpacesLeft + data_width + num_fields * step + 1;
+
+    struct template_lines
+    {
+        char row[line_len];
+        char border[border_len];
+
+        template_lines()
+        {
+            static const size_t widths[] = { Fields::width..., 0 };
+            size_t offset = SpacesLeft + lead;
+
+            memset(row, ' ', line_len);
+            row[line_len - 1] = '\n';
+            memset(border, ' ', border_len);
+            border[border_len - 1] = '\n';
+            if (Border != border::ascii)
+                return;
+
+            for (size_t i = 0; i < num_fields; i++)
+            {
+                row[offset - half - 1] = '|';
+                offset += widths[i] + step;
+            }
+            row[line_len - 2] = '|';
+            if (border_len > SpacesLeft + 2)
+                memset(border + SpacesLeft + 1, '=', border_len - SpacesLeft - 2);
+        }
+    };
+
+    static const template_lines &templates()
+    {
+        static const template_lines lines;
+        return lines;
+    }
+};
+
+} // namespace tprint
+
+#endif
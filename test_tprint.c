@@ -16,12 +16,1533 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "linked-list.h"
 #include "table-print.h"
 
+static int failures = 0;
+
+// compare what was printed to 'f' since the last check with 'expected', then empty 'f'
+static void check_output (const char *name, FILE *f, const char *expected)
+{
+    char buf[4096];
+    size_t len;
+
+    fflush (f);
+    rewind (f);
+    len = fread (buf, 1, sizeof (buf) - 1, f);
+    buf[len] = '\0';
+    if (strcmp (buf, expected)) {
+        fprintf (stderr, "FAIL %s: printed\n%s\nexpected\n%s\n", name, buf, expected);
+        failures++;
+    }
+    rewind (f);
+    if (ftruncate (fileno (f), 0))
+        perror ("ftruncate");
+}
+
+static void check_cell (const char *name, struct table_print_t *tp, int col, int row, const char *expected)
+{
+    const char *cell;
+    int len;
+
+    cell = table_print_get_cell (tp, col, row, &len);
+    if (!cell || len != (int) strlen (expected) || memcmp (cell, expected, len)) {
+        fprintf (stderr, "FAIL %s: cell (%d, %d) is \"%.*s\", expected \"%s\"\n", name, col, row,
+            cell ? len : 0, cell ? cell : "", expected);
+        failures++;
+    }
+}
+
+// Run 'func' in a child process, which must stop with fatal()
+static void check_fatal (const char *name, void (*func) (FILE *), FILE *f)
+{
+    pid_t pid;
+    int status;
+
+    fflush (NULL);
+    pid = fork ();
+    if (pid < 0) {
+        perror ("fork");
+        failures++;
+        return;
+    }
+    if (!pid) {
+        if (!freopen ("/dev/null", "w", stderr))
+            _exit (2);
+        func (f);
+        _exit (0);
+    }
+    if (waitpid (pid, &status, 0) != pid || !WIFEXITED (status) || WEXITSTATUS (status) != 1) {
+        fprintf (stderr, "FAIL %s: did not stop with fatal()\n", name);
+        failures++;
+    }
+}
+
+static struct table_print_t *create_table (FILE *f, int cols)
+{
+    struct table_print_t *tp;
+    char caption[16];
+    int i;
+
+    tp = table_print_create (f, FALSE, TRUE, 0, 1);
+    for (i = 0; i < cols; i++) {
+        snprintf (caption, sizeof (caption), "c%d", i);
+        table_print_column_add (tp, caption, table_print_align_left, table_print_align_left);
+    }
+    return tp;
+}
+
+// cells stored inside the row blocks, in the arena, and bigger than an arena chunk
+static void test_inline_cells (FILE *f)
+{
+    struct table_print_t *tp;
+    char big[5001], buf[16];
+    int i;
+
+    memset (big, 'x', sizeof (big) - 1);
+    big[sizeof (big) - 1] = '\0';
+
+    tp = create_table (f, 2);
+    table_print_data_add_str (tp, 0, "");
+    table_print_data_add_str (tp, 1, "0123456789abcdef");
+    table_print_data_add_str (tp, 0, "0123456789abcdefg");
+    table_print_data_add_str (tp, 1, "a\0b");
+    table_print_print (tp);
+    check_output ("inline cells", f,
+        "c0                c1              \n"
+        "                  0123456789abcdef\n"
+        "0123456789abcdefg a               \n");
+
+    for (i = 0; i < 300; i++) {
+        snprintf (buf, sizeof (buf), "row %d of 300", i);
+        table_print_data_add_str (tp, 0, i == 150 ? big : buf);
+        table_print_data_add_str (tp, 1, i % 2 ? "0123456789abcdef-" : "short");
+    }
+    check_cell ("inline cells", tp, 0, 0, "");
+    check_cell ("inline cells", tp, 1, 1, "a");
+    check_cell ("inline cells", tp, 0, 151, "row 149 of 300");
+    check_cell ("inline cells", tp, 0, 152, big);
+    check_cell ("inline cells", tp, 0, 153, "row 151 of 300");
+    check_cell ("inline cells", tp, 1, 300, "short");
+    check_cell ("inline cells", tp, 1, 301, "0123456789abcdef-");
+    table_print_free (tp);
+}
+
+// the cached layout is used again while it holds, and made again when widths change
+static void test_render_plan (FILE *f)
+{
+    struct table_print_t *tp;
+
+    tp = table_print_create (f, TRUE, TRUE, 2, 2);
+    table_print_column_add (tp, "left", table_print_align_center, table_print_align_left);
+    table_print_column_add (tp, "mid", table_print_align_left, table_print_align_center);
+    table_print_column_add (tp, "r", table_print_align_right, table_print_align_right);
+    table_print_data_add_str (tp, 0, "a");
+    table_print_data_add_str (tp, 1, "b");
+    table_print_data_add_str (tp, 2, "c");
+    table_print_print (tp);
+    table_print_print (tp);
+    check_output ("render plan", f,
+        "   ================\n"
+        "  | left | mid | r |\n"
+        "   ================\n"
+        "  | a    |  b  | c |\n"
+        "   ================\n"
+        "   ================\n"
+        "  | left | mid | r |\n"
+        "   ================\n"
+        "  | a    |  b  | c |\n"
+        "   ================\n");
+
+    table_print_data_add_str (tp, 0, "wider");
+    table_print_data_add_str (tp, 1, "cell");
+    table_print_data_add_int32 (tp, 2, 12);
+    table_print_print (tp);
+    check_output ("render plan new widths", f,
+        "   ===================\n"
+        "  | left  | mid  |  r |\n"
+        "   ===================\n"
+        "  | a     |  b   |  c |\n"
+        "  | wider | cell | 12 |\n"
+        "   ===================\n");
+    table_print_free (tp);
+}
+
+// cells wider than the limit, cut between UTF-8 characters
+static void test_max_width (FILE *f)
+{
+    struct table_print_t *tp;
+
+    tp = create_table (f, 3);
+    table_print_column_set_max_width (tp, 0, 5, table_print_overflow_truncate);
+    table_print_column_set_max_width (tp, 1, 6, table_print_overflow_ellipsis);
+    table_print_column_set_max_width (tp, 2, 4, table_print_overflow_wrap);
+    table_print_data_add_str (tp, 0, "truncated");
+    table_print_data_add_str (tp, 1, "with an ellipsis");
+    table_print_data_add_str (tp, 2, "wrapped cell");
+    table_print_data_add_str (tp, 0, "ab");
+    table_print_data_add_str (tp, 1, "fits");
+    table_print_data_add_str (tp, 2, "ok");
+    table_print_print (tp);
+    check_output ("max width", f,
+        "c0    c1     c2  \n"
+        "trunc wit... wrap\n"
+        "             ped \n"
+        "             cell\n"
+        "ab    fits   ok  \n");
+
+    // "\xc3\xa9" is two bytes wide
+    table_print_clear (tp);
+    table_print_data_add_str (tp, 0, "\xc3\xa9\xc3\xa9\xc3\xa9");
+    table_print_data_add_str (tp, 1, "\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9");
+    table_print_data_add_str (tp, 2, "a\xc3\xa9\xc3\xa9");
+    table_print_print (tp);
+    check_output ("max width utf-8", f,
+        "c0    c1     c2  \n"
+        "\xc3\xa9\xc3\xa9  \xc3\xa9 ... a\xc3\xa9 \n"
+        "             \xc3\xa9  \n");
+    table_print_free (tp);
+}
+
+// rows moved to the spill file past the memory budget and read back
+static void test_spill (FILE *f)
+{
+    struct table_print_t *tp, *groups;
+    const int key = 2;
+    struct table_print_aggregate_t aggs[] = {
+        { 0, table_print_agg_count },
+        { 1, table_print_agg_max },
+    };
+    char buf[16];
+    int len;
+    int i;
+
+    tp = create_table (f, 3);
+    table_print_column_set_encoding (tp, 2, table_print_encoding_dict);
+    table_print_set_memory_budget (tp, 1);
+    for (i = 0; i < 2000; i++) {
+        snprintf (buf, sizeof (buf), "row %d", i);
+        table_print_data_add_str (tp, 0, buf);
+        table_print_data_add_int32 (tp, 1, i);
+        table_print_data_add_str (tp, 2, i % 2 ? "odd" : "even");
+    }
+    // spilled rows cannot be read outside of a print
+    table_print_get_cell (tp, 0, 0, &len);
+    if (len) {
+        fprintf (stderr, "FAIL spill: spilled cell of %d bytes\n", len);
+        failures++;
+    }
+    check_cell ("spill", tp, 0, 1999, "row 1999");
+
+    table_print_set_filter (tp, table_print_filter_or (
+        table_print_filter_number (1, table_print_cmp_lt, 2),
+        table_print_filter_and (
+            table_print_filter_str (0, table_print_cmp_prefix, "row 199"),
+            table_print_filter_str (2, table_print_cmp_eq, "odd"))));
+    table_print_print (tp);
+    check_output ("spill filter", f,
+        "c0       c1   c2  \n"
+        "row 0    0    even\n"
+        "row 1    1    odd \n"
+        "row 199  199  odd \n"
+        "row 1991 1991 odd \n"
+        "row 1993 1993 odd \n"
+        "row 1995 1995 odd \n"
+        "row 1997 1997 odd \n"
+        "row 1999 1999 odd \n");
+
+    groups = table_print_group_by (tp, &key, 1, aggs, 2);
+    table_print_print (groups);
+    check_output ("spill group by", f,
+        "c2   count max(c1) \n"
+        "even  1000 1998.000\n"
+        "odd   1000 1999.000\n");
+    table_print_free (groups);
+    table_print_free (tp);
+}
+
+// differences of any sign and size between consecutive values
+static void test_delta (FILE *f)
+{
+    struct table_print_t *tp;
+    char buf[16];
+    int i;
+
+    tp = create_table (f, 2);
+    table_print_column_set_encoding (tp, 0, table_print_encoding_delta);
+    table_print_column_set_encoding (tp, 1, table_print_encoding_delta);
+    table_print_data_add_int32 (tp, 0, -5);
+    table_print_data_add_int32 (tp, 0, -2147483647 - 1);
+    table_print_data_add_int32 (tp, 0, 2147483647);
+    table_print_set_cell (tp, 0, 3, "-9223372036854775808");
+    table_print_set_cell (tp, 0, 4, "9223372036854775807");
+    table_print_data_add_int32 (tp, 0, 0);
+    table_print_data_add_uint64 (tp, 1, 0);
+    table_print_data_add_uint64 (tp, 1, 18446744073709551615ULL);
+    table_print_data_add_uint64 (tp, 1, 1);
+    table_print_data_add_uint64 (tp, 1, 18446744073709551614ULL);
+    table_print_print (tp);
+    check_output ("delta", f,
+        "c0                   c1                  \n"
+        "-5                   0                   \n"
+        "-2147483648          18446744073709551615\n"
+        "2147483647           1                   \n"
+        "-9223372036854775808 18446744073709551614\n"
+        "9223372036854775807                      \n"
+        "0                                        \n");
+
+    table_print_clear (tp);
+    for (i = 0; i < 600; i++)
+        table_print_data_add_int32 (tp, 0, 1000 - i * i);
+    for (i = 0; i < 600; i += 299) {
+        snprintf (buf, sizeof (buf), "%d", 1000 - i * i);
+        check_cell ("delta", tp, 0, i, buf);
+    }
+    table_print_free (tp);
+}
+
+static void async_done (struct table_print_t *tp, void *data)
+{
+    (*(int *) data)++;
+    table_print_free (tp);
+}
+
+// tables printed by the writer thread in the order they were given
+static void test_async (FILE *f)
+{
+    struct table_print_t *tp;
+    char buf[16];
+    int done = 0;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        tp = create_table (f, 1);
+        snprintf (buf, sizeof (buf), "table %d", i);
+        table_print_data_add_str (tp, 0, buf);
+        table_print_print_async (tp, i == 1 ? NULL : async_done, &done);
+    }
+    table_print_async_wait ();
+    if (done != 2) {
+        fprintf (stderr, "FAIL async: %d tables done, expected 2\n", done);
+        failures++;
+    }
+    check_output ("async", f,
+        "c0     \n"
+        "table 0\n"
+        "c0     \n"
+        "table 1\n"
+        "c0     \n"
+        "table 2\n");
+}
+
+static void *snapshot_producer (void *arg)
+{
+    struct table_print_snapshot_t *snap = arg;
+    struct table_print_t *tp;
+    int i;
+
+    for (i = 0; i < 2000; i++) {
+        tp = table_print_snapshot_begin_row (snap);
+        table_print_data_add_int32 (tp, 0, i);
+        table_print_data_add_int32 (tp, 1, i);
+        table_print_snapshot_end_row (snap);
+    }
+    return NULL;
+}
+
+// Check the rows printed to 'f' by snapshots of the producer: no partial row, and
+// the whole table each time. Returns the number of rows of the last print
+static int check_snapshot_rows (FILE *f)
+{
+    char line[64];
+    int rows = 0;
+    int a, b;
+
+    fflush (f);
+    rewind (f);
+    while (fgets (line, sizeof (line), f)) {
+        if (line[0] == 'c') {
+            rows = 0;
+            continue;
+        }
+        if (sscanf (line, "%d %d", &a, &b) != 2 || a != b || a != rows) {
+            fprintf (stderr, "FAIL snapshot rows: row %d is %s", rows, line);
+            failures++;
+        }
+        rows++;
+    }
+    rewind (f);
+    if (ftruncate (fileno (f), 0))
+        perror ("ftruncate");
+    return rows;
+}
+
+// complete rows only, while a producer keeps adding more
+static void test_snapshot_print (FILE *f)
+{
+    struct table_print_snapshot_t *snap;
+    struct table_print_t *tp;
+    pthread_t thread;
+    int rows;
+
+    snap = table_print_snapshot_create (create_table (f, 2));
+    tp = table_print_snapshot_begin_row (snap);
+    table_print_data_add_str (tp, 0, "first");
+    table_print_data_add_str (tp, 1, "row");
+    table_print_snapshot_end_row (snap);
+    table_print_snapshot_print (snap);
+    tp = table_print_snapshot_begin_row (snap);
+    table_print_data_add_str (tp, 0, "second");
+    table_print_data_add_str (tp, 1, "row");
+    table_print_snapshot_end_row (snap);
+    table_print_snapshot_print (snap);
+    check_output ("snapshot print", f,
+        "c0    c1 \n"
+        "first row\n"
+        "c0     c1 \n"
+        "first  row\n"
+        "second row\n");
+    table_print_snapshot_free (snap);
+
+    snap = table_print_snapshot_create (create_table (f, 2));
+    if (pthread_create (&thread, NULL, snapshot_producer, snap)) {
+        perror ("pthread_create");
+        failures++;
+        table_print_snapshot_free (snap);
+        return;
+    }
+    for (rows = 0; rows < 20; rows++)
+        table_print_snapshot_print (snap);
+    pthread_join (thread, NULL);
+    check_snapshot_rows (f);
+    table_print_snapshot_print (snap);
+    rows = check_snapshot_rows (f);
+    if (rows != 2000) {
+        fprintf (stderr, "FAIL snapshot print: %d rows, expected 2000\n", rows);
+        failures++;
+    }
+    table_print_snapshot_free (snap);
+}
+
+// columns printed in another order, repeated or left out
+static void test_view (FILE *f)
+{
+    struct table_print_t *tp;
+    const int cols[] = { 2, 0, 2 };
+
+    tp = table_print_create (f, TRUE, TRUE, 0, 2);
+    table_print_column_add (tp, "name", table_print_align_left, table_print_align_left);
+    table_print_column_add (tp, "a long caption", table_print_align_left, table_print_align_left);
+    table_print_column_add (tp, "n", table_print_align_left, table_print_align_right);
+    table_print_data_add_str (tp, 0, "x");
+    table_print_data_add_str (tp, 1, "y");
+    table_print_data_add_int32 (tp, 2, 42);
+    table_print_set_view (tp, cols, 3);
+    table_print_print (tp);
+    check_output ("view", f,
+        " ================\n"
+        "| n  | name | n  |\n"
+        " ================\n"
+        "| 42 | x    | 42 |\n"
+        " ================\n");
+
+    table_print_set_view (tp, NULL, 0);
+    table_print_print (tp);
+    check_output ("view reset", f,
+        " ============================\n"
+        "| name | a long caption | n  |\n"
+        " ============================\n"
+        "| x    | y              | 42 |\n"
+        " ============================\n");
+    table_print_free (tp);
+}
+
+static struct table_print_t *create_fruits (FILE *f)
+{
+    struct table_print_t *tp;
+    const char *names[] = { "apple", "pear", "apricot", "plum", "avocado" };
+    const char *sizes[] = { "3", "12", "7", "20", "n/a" };
+    int i;
+
+    tp = create_table (f, 3);
+    for (i = 0; i < 5; i++) {
+        table_print_data_add_str (tp, 0, names[i][0] == 'a' ? "a" : "p");
+        table_print_data_add_str (tp, 1, names[i]);
+        table_print_data_add_str (tp, 2, sizes[i]);
+    }
+    return tp;
+}
+
+// only the rows that pass are printed, and they alone make the widths
+static void test_filter (FILE *f)
+{
+    struct table_print_t *tp;
+
+    tp = create_fruits (f);
+    table_print_set_filter (tp, table_print_filter_and (
+        table_print_filter_str (1, table_print_cmp_prefix, "a"),
+        table_print_filter_number (2, table_print_cmp_gt, 4)));
+    table_print_print (tp);
+    check_output ("filter", f,
+        "c0 c1      c2\n"
+        "a  apricot 7 \n");
+
+    table_print_set_filter (tp, table_print_filter_or (
+        table_print_filter_range (2, 10, 12),
+        table_print_filter_str (1, table_print_cmp_eq, "apple")));
+    table_print_print (tp);
+    check_output ("filter or", f,
+        "c0 c1    c2\n"
+        "a  apple 3 \n"
+        "p  pear  12\n");
+
+    table_print_set_filter (tp, table_print_filter_number (2, table_print_cmp_ne, 3));
+    table_print_print (tp);
+    check_output ("filter not a number", f,
+        "c0 c1      c2\n"
+        "p  pear    12\n"
+        "a  apricot 7 \n"
+        "p  plum    20\n");
+
+    table_print_set_filter (tp, NULL);
+    table_print_print (tp);
+    check_output ("no filter", f,
+        "c0 c1      c2 \n"
+        "a  apple   3  \n"
+        "p  pear    12 \n"
+        "a  apricot 7  \n"
+        "p  plum    20 \n"
+        "a  avocado n/a\n");
+    table_print_free (tp);
+}
+
+// one row per key in order of first appearance, aggregates over the numbers only
+static void test_group_by (FILE *f)
+{
+    struct table_print_t *tp, *groups;
+    const int key = 0;
+    struct table_print_aggregate_t aggs[] = {
+        { 0, table_print_agg_count },
+        { 2, table_print_agg_sum },
+        { 2, table_print_agg_min },
+        { 2, table_print_agg_max },
+        { 2, table_print_agg_mean },
+    };
+
+    tp = create_fruits (f);
+    // the filter of the source does not apply
+    table_print_set_filter (tp, table_print_filter_str (0, table_print_cmp_eq, "p"));
+    groups = table_print_group_by (tp, &key, 1, aggs, 5);
+    table_print_print (groups);
+    check_output ("group by", f,
+        "c0 count sum(c2) min(c2) max(c2) mean(c2)\n"
+        "a      3  10.000   3.000   7.000    5.000\n"
+        "p      2  32.000  12.000  20.000   16.000\n");
+    check_cell ("group by", groups, 1, 1, "2");
+    table_print_free (groups);
+    table_print_free (tp);
+}
+
+struct list_item_t
+{
+    int key;
+    int seq;
+};
+
+static int list_item_compare (const void *a, const void *b)
+{
+    return ((const struct list_item_t *) a)->key - ((const struct list_item_t *) b)->key;
+}
+
+// positions reached from either end or the current element, and a stable sort
+static void test_list (void)
+{
+    struct linked_list_t *list;
+    struct list_item_t items[1000];
+    struct list_item_t *order[1000];
+    struct list_item_t *item, *prev = NULL;
+    const int steps[] = { 10, 990, 500, 501, 499, 0, 989, 250 };
+    int i;
+
+    list = linked_list_create ();
+    for (i = 0; i < 1000; i++) {
+        items[i].key = (i * 7919) % 13;
+        linked_list_add (list, &items[i]);
+    }
+    // the removed elements are reused by the following insertions
+    linked_list_goto (list, 100);
+    for (i = 0; i < 10; i++)
+        linked_list_remove (list);
+    linked_list_head (list);
+    for (i = 0; i < 10; i++)
+        linked_list_insert (list, &items[100 + i]);
+    LINKED_LIST_FOR_EACH (list) {
+        item = linked_list_get (list);
+        item->seq = linked_list_current (list);
+        order[item->seq] = item;
+    }
+
+    for (i = 0; i < (int) (sizeof (steps) / sizeof (steps[0])); i++) {
+        linked_list_goto (list, steps[i]);
+        item = linked_list_get (list);
+        if (list->error_code || linked_list_current (list) != steps[i] || item != order[steps[i]]) {
+            fprintf (stderr, "FAIL list goto %d: found element %d\n", steps[i], item ? item->seq : -1);
+            failures++;
+        }
+    }
+    linked_list_goto (list, 1000);
+    if (list->error_code || !linked_list_is_end (list)) {
+        fprintf (stderr, "FAIL list goto the end\n");
+        failures++;
+    }
+    linked_list_goto (list, 1001);
+    if (list->error_code != LINKED_LIST_ERR_BOUNDS) {
+        fprintf (stderr, "FAIL list goto past the end\n");
+        failures++;
+    }
+
+    linked_list_sort (list, list_item_compare);
+    if (!linked_list_sorted (list, list_item_compare) || linked_list_count (list) != 1000) {
+        fprintf (stderr, "FAIL list sort: not sorted\n");
+        failures++;
+    }
+    // equal keys keep their order
+    LINKED_LIST_FOR_EACH (list) {
+        item = linked_list_get (list);
+        if (prev && prev->key == item->key && prev->seq > item->seq) {
+            fprintf (stderr, "FAIL list sort: %d before %d\n", prev->seq, item->seq);
+            failures++;
+        }
+        prev = item;
+    }
+    linked_list_free (list);
+}
+
+static void release_count (void *data)
+{
+    int *released = data;
+
+    // releases run in the order they were added
+    *released = *released * 10 + 1;
+}
+
+static void release_double (void *data)
+{
+    int *released = data;
+
+    *released *= 2;
+}
+
+// cells that point to the memory of the caller until the table releases it
+static void test_borrowed (FILE *f)
+{
+    struct table_print_t *tp;
+    char names[] = "alpha beta gamma";
+    const char *words[] = { "one", "two", "three" };
+    const int lens[] = { 1, 2, 5 };
+    const int numbers[] = { -1, 20 };
+    const double values[] = { 0.5, 1.25 };
+    int released = 0;
+
+    tp = create_table (f, 4);
+    table_print_column_set_encoding (tp, 3, table_print_encoding_dict);
+    table_print_data_add_str_ref (tp, 0, names, 5);
+    table_print_data_add_str_ref (tp, 0, names + 6, 4);
+    table_print_data_add_str_ref_array (tp, 1, words, lens, 3);
+    table_print_data_add_int32_array (tp, 2, numbers, 2);
+    table_print_data_add_double_array (tp, 2, values, 2);
+    table_print_data_add_str_ref_array (tp, 3, words, NULL, 3);
+    table_print_add_release (tp, release_count, &released);
+    table_print_add_release (tp, release_double, &released);
+
+    // not copied: the table sees the new bytes
+    names[0] = 'A';
+    table_print_print (tp);
+    check_output ("borrowed cells", f,
+        "c0    c1    c2    c3   \n"
+        "Alpha o     -1    one  \n"
+        "beta  tw    20    two  \n"
+        "      three 0.500 three\n"
+        "            1.250      \n");
+
+    if (released) {
+        fprintf (stderr, "FAIL borrowed cells: released before the table was cleared\n");
+        failures++;
+    }
+    table_print_clear (tp);
+    if (released != 2) {
+        fprintf (stderr, "FAIL borrowed cells: released %d, expected 2\n", released);
+        failures++;
+    }
+    table_print_free (tp);
+    if (released != 2) {
+        fprintf (stderr, "FAIL borrowed cells: released again\n");
+        failures++;
+    }
+}
+
+static void log_string_in_delta_column (FILE *f)
+{
+    struct table_print_t *tp;
+    const struct table_print_field_t field = { table_print_type_str, 8 };
+
+    tp = create_table (f, 1);
+    table_print_column_set_encoding (tp, 0, table_print_encoding_delta);
+    table_print_log_create (f, tp, &field, 1);
+}
+
+struct log_record_t
+{
+    int id;
+    unsigned long long bytes;
+    char name[8];
+};
+
+static void test_log (FILE *f)
+{
+    struct table_print_t *tp, *read;
+    struct table_print_log_t *log;
+    const struct table_print_field_t fields[] = {
+        { table_print_type_int32, 0 },
+        { table_print_type_uint64, 0 },
+        { table_print_type_str, 8 },
+    };
+    struct log_record_t rec;
+    FILE *lf;
+    int i;
+
+    lf = tmpfile ();
+    tp = create_table (f, 3);
+    table_print_column_set_encoding (tp, 0, table_print_encoding_delta);
+    table_print_column_set_encoding (tp, 2, table_print_encoding_dict);
+    log = table_print_log_create (lf, tp, fields, 3);
+    if (table_print_log_record_size (log) != (int) sizeof (rec)) {
+        fprintf (stderr, "FAIL log: record size %d, expected %d\n", table_print_log_record_size (log), (int) sizeof (rec));
+        failures++;
+    }
+    for (i = 0; i < 3; i++) {
+        memset (&rec, 0, sizeof (rec));
+        rec.id = i - 1;
+        rec.bytes = 1ULL << (20 * i);
+        // a full field has no null
+        memcpy (rec.name, i == 1 ? "12345678" : "log", i == 1 ? 8 : 4);
+        table_print_log_append (log, &rec);
+    }
+    table_print_log_free (log);
+    table_print_free (tp);
+
+    rewind (lf);
+    read = table_print_log_read (lf, f);
+    if (!read) {
+        fprintf (stderr, "FAIL log: cannot read the log\n");
+        failures++;
+    } else {
+        table_print_print (read);
+        check_output ("log", f,
+            "c0 c1            c2      \n"
+            "-1 1             log     \n"
+            "0  1048576       12345678\n"
+            "1  1099511627776 log     \n");
+        table_print_free (read);
+    }
+    fclose (lf);
+
+    check_fatal ("log field type", log_string_in_delta_column, f);
+}
+
+
+// Run the tprint tool of the build directory on 'input' and compare its output with 'expected'
+static void check_tprint (const char *name, const char *args, const char *input, size_t len, const char *expected)
+{
+    char in_path[] = "/tmp/test_tprint_in_XXXXXX";
+    char out_path[] = "/tmp/test_tprint_out_XXXXXX";
+    char cmd[256];
+    FILE *out;
+    int in_fd, out_fd;
+
+    in_fd = mkstemp (in_path);
+    out_fd = mkstemp (out_path);
+    if (in_fd < 0 || out_fd < 0 || write (in_fd, input, len) != (ssize_t) len) {
+        perror ("tprint input");
+        failures++;
+    } else {
+        snprintf (cmd, sizeof (cmd), "./tprint %s < %s > %s", args, in_path, out_path);
+        if (system (cmd)) {
+            fprintf (stderr, "FAIL %s: %s failed\n", name, cmd);
+            failures++;
+        } else {
+            out = fdopen (dup (out_fd), "r+");
+            check_output (name, out, expected);
+            fclose (out);
+        }
+    }
+    if (in_fd >= 0)
+        close (in_fd);
+    if (out_fd >= 0)
+        close (out_fd);
+    unlink (in_path);
+    unlink (out_path);
+}
+
+// the command line tool, on a whole file and streamed
+static void test_tprint_tool (void)
+{
+    const char *input = "name,size\nfoo,1\nlonger,22\n";
+    char *big;
+    size_t len = 3 * 1024 * 1024;
+
+    check_tprint ("tprint", "-d , -H -a lr -g 1", input, strlen (input),
+        "name   size\n"
+        "foo       1\n"
+        "longer   22\n");
+    check_tprint ("tprint stream", "-d , -H -a c -b -S 1", input, strlen (input),
+        " =============\n"
+        "| name | size |\n"
+        " =============\n"
+        "| foo  |  1   |\n"
+        " =============\n"
+        " ===============\n"
+        "|  name  | size |\n"
+        " ===============\n"
+        "| longer |  22  |\n"
+        " ===============\n");
+
+    // a line longer than the stream buffer
+    big = malloc (len);
+    if (!big)
+        return;
+    memcpy (big, "name,size\n", 10);
+    memset (big + 10, 'x', len - 10);
+    memcpy (big + len - 7, ",7\nb,2\n", 7);
+    check_tprint ("tprint long line", "-d , -H -w 5 -S 2", big, len,
+        "name   size\n"
+        "xx...  7   \n"
+        "b      2   \n");
+    free (big);
+}
+
+// the oldest rows are overwritten and the columns narrow with them
+static void test_ring (FILE *f)
+{
+    struct table_print_t *tp;
+    const char *cells[] = { "a", "the widest", "b", "c", "d" };
+    int i;
+
+    tp = create_table (f, 2);
+    table_print_set_ring (tp, 3);
+    for (i = 0; i < 5; i++) {
+        table_print_data_add_str (tp, 0, cells[i]);
+        table_print_data_add_int32 (tp, 1, i);
+        if (i == 2) {
+            table_print_print (tp);
+            check_output ("ring", f,
+                "c0         c1\n"
+                "a          0 \n"
+                "the widest 1 \n"
+                "b          2 \n");
+        }
+    }
+    check_cell ("ring", tp, 0, 0, "b");
+    table_print_print (tp);
+    check_output ("ring overwritten", f,
+        "c0 c1\n"
+        "b  2 \n"
+        "c  3 \n"
+        "d  4 \n");
+    table_print_free (tp);
+}
+
+// rows moved from partly filled blocks, and found again across block boundaries
+static void test_merge (FILE *f)
+{
+    struct table_print_t *dst, *src, *srcs[2];
+    char buf[16];
+    int i;
+
+    dst = create_table (f, 2);
+    src = create_table (f, 2);
+    table_print_column_set_encoding (src, 1, table_print_encoding_dict);
+    table_print_column_set_encoding (dst, 1, table_print_encoding_dict);
+    for (i = 0; i < 300; i++) {
+        snprintf (buf, sizeof (buf), "%d", i);
+        table_print_data_add_str (dst, 0, buf);
+        table_print_data_add_str (dst, 1, i % 2 ? "odd" : "even");
+        snprintf (buf, sizeof (buf), "%d", 1000 + i);
+        table_print_data_add_str (src, 0, buf);
+        table_print_data_add_str (src, 1, i % 3 ? "many" : "three");
+    }
+    // leave the last block of both tables partly used
+    table_print_delete_row (dst, 10);
+    table_print_delete_row (src, 0);
+    table_print_merge (dst, src);
+    check_cell ("merge", dst, 0, 9, "9");
+    check_cell ("merge", dst, 0, 10, "11");
+    check_cell ("merge", dst, 0, 298, "299");
+    check_cell ("merge", dst, 1, 298, "odd");
+    check_cell ("merge", dst, 0, 299, "1001");
+    check_cell ("merge", dst, 1, 299, "many");
+    check_cell ("merge", dst, 0, 300, "1002");
+    check_cell ("merge", dst, 0, 597, "1299");
+    check_cell ("merge", dst, 1, 595, "three");
+    table_print_free (src);
+    table_print_free (dst);
+
+    dst = create_table (f, 1);
+    srcs[0] = create_table (f, 1);
+    srcs[1] = create_table (f, 1);
+    table_print_data_add_int32 (srcs[0], 0, 1);
+    table_print_data_add_int32 (srcs[0], 0, 10);
+    table_print_data_add_int32 (srcs[1], 0, 2);
+    table_print_data_add_int32 (srcs[1], 0, 3);
+    table_print_merge_sorted (dst, srcs, 2, 0, TRUE);
+    table_print_print (dst);
+    check_output ("merge sorted", f,
+        "c0\n"
+        "1 \n"
+        "2 \n"
+        "3 \n"
+        "10\n");
+    table_print_free (srcs[0]);
+    table_print_free (srcs[1]);
+    table_print_free (dst);
+}
+
+
+// rows saved and loaded again with mmap
+static void test_save (FILE *f)
+{
+    struct table_print_t *tp, *loaded;
+    char path[] = "/tmp/test_tprint_XXXXXX";
+    int fd;
+
+    tp = create_table (f, 3);
+    table_print_column_set_encoding (tp, 1, table_print_encoding_dict);
+    table_print_column_set_encoding (tp, 2, table_print_encoding_delta);
+    table_print_data_add_str (tp, 0, "first");
+    table_print_data_add_str (tp, 1, "red");
+    table_print_data_add_uint64 (tp, 2, 1000);
+    table_print_data_add_str (tp, 0, "second");
+    table_print_data_add_str (tp, 1, "green");
+    table_print_data_add_uint64 (tp, 2, 998);
+    table_print_data_add_str (tp, 0, "third");
+    table_print_data_add_str (tp, 1, "red");
+
+    fd = mkstemp (path);
+    if (fd < 0) {
+        perror ("mkstemp");
+        failures++;
+        table_print_free (tp);
+        return;
+    }
+    close (fd);
+    if (!table_print_save (tp, path)) {
+        fprintf (stderr, "FAIL save: cannot save %s\n", path);
+        failures++;
+    }
+    table_print_free (tp);
+
+    loaded = table_print_load_mmap (path, f);
+    if (!loaded) {
+        fprintf (stderr, "FAIL save: cannot load %s\n", path);
+        failures++;
+    } else {
+        check_cell ("save", loaded, 1, 2, "red");
+        table_print_print (loaded);
+        check_output ("save", f,
+            "c0     c1    c2  \n"
+            "first  red   1000\n"
+            "second green 998 \n"
+            "third  red       \n");
+        table_print_free (loaded);
+    }
+    unlink (path);
+}
+
+// rows added to a spilling table after a save read back the spill file
+static void test_save_spilled (FILE *f)
+{
+    struct table_print_t *tp, *loaded;
+    char path[] = "/tmp/test_tprint_XXXXXX";
+    char buf[16];
+    int fd;
+    int i;
+
+    fd = mkstemp (path);
+    if (fd < 0) {
+        perror ("mkstemp");
+        failures++;
+        return;
+    }
+    close (fd);
+
+    tp = create_table (f, 2);
+    table_print_set_memory_budget (tp, 1);
+    for (i = 0; i < 900; i++) {
+        if (i == 600 && !table_print_save (tp, path)) {
+            fprintf (stderr, "FAIL save spilled: cannot save %s\n", path);
+            failures++;
+        }
+        snprintf (buf, sizeof (buf), "row %d", i);
+        table_print_data_add_str (tp, 0, buf);
+        table_print_data_add_int32 (tp, 1, i);
+    }
+    table_print_set_filter (tp, table_print_filter_or (
+        table_print_filter_range (1, 598, 601),
+        table_print_filter_number (1, table_print_cmp_eq, 899)));
+    table_print_print (tp);
+    check_output ("save spilled", f,
+        "c0      c1 \n"
+        "row 598 598\n"
+        "row 599 599\n"
+        "row 600 600\n"
+        "row 601 601\n"
+        "row 899 899\n");
+    table_print_free (tp);
+
+    loaded = table_print_load_mmap (path, f);
+    if (!loaded) {
+        fprintf (stderr, "FAIL save spilled: cannot load %s\n", path);
+        failures++;
+    } else {
+        check_cell ("save spilled", loaded, 0, 0, "row 0");
+        check_cell ("save spilled", loaded, 1, 599, "599");
+        check_cell ("save spilled", loaded, 1, 600, "");
+        table_print_free (loaded);
+    }
+    unlink (path);
+}
+
+
+// a cell made of the name in column 0 and the double of column 1
+static int virtual_cell (struct table_print_t *tp, int row, char *buf, int size, void *data)
+{
+    const char *name;
+    double value = 0;
+    int len;
+
+    (*(int *) data)++;
+    name = table_print_get_cell (tp, 0, row, &len);
+    table_print_get_number (tp, 1, row, &value);
+    return snprintf (buf, size, "%.*s=%g", len, name, value * 2);
+}
+
+// cells made when printed, and made again only after the data changes
+static void test_virtual (FILE *f)
+{
+    struct table_print_t *tp;
+    int calls = 0;
+
+    tp = create_table (f, 2);
+    table_print_column_add_virtual (tp, "v", table_print_align_left, table_print_align_right, virtual_cell, &calls);
+    table_print_data_add_str (tp, 0, "a");
+    table_print_data_add_int32 (tp, 1, 1);
+    table_print_data_add_str (tp, 0, "a longer name");
+    table_print_data_add_int32 (tp, 1, 21);
+    table_print_print (tp);
+    table_print_print (tp);
+    check_output ("virtual", f,
+        "c0            c1 v               \n"
+        "a             1               a=2\n"
+        "a longer name 21 a longer name=42\n"
+        "c0            c1 v               \n"
+        "a             1               a=2\n"
+        "a longer name 21 a longer name=42\n");
+    if (calls != 2) {
+        fprintf (stderr, "FAIL virtual: %d calls, expected 2\n", calls);
+        failures++;
+    }
+
+    calls = 0;
+    table_print_data_add_str (tp, 0, "b");
+    table_print_data_add_int32 (tp, 1, 3);
+    table_print_set_filter (tp, table_print_filter_str (2, table_print_cmp_prefix, "b"));
+    table_print_print (tp);
+    check_output ("virtual filter", f,
+        "c0 c1 v  \n"
+        "b  3  b=6\n");
+    if (calls != 3) {
+        fprintf (stderr, "FAIL virtual filter: %d calls, expected 3\n", calls);
+        failures++;
+    }
+    table_print_free (tp);
+}
+
+
+// column widths follow the cells that are edited, deleted and inserted
+static void test_edit (FILE *f)
+{
+    struct table_print_t *tp;
+
+    tp = create_table (f, 2);
+    table_print_data_add_str (tp, 0, "a");
+    table_print_data_add_str (tp, 1, "1");
+    table_print_data_add_str (tp, 0, "widest cell");
+    table_print_data_add_str (tp, 1, "2");
+    table_print_data_add_str (tp, 0, "c");
+    table_print_data_add_str (tp, 1, "3");
+
+    table_print_set_cell (tp, 0, 1, "bb");
+    table_print_print (tp);
+    check_output ("set cell", f,
+        "c0 c1\n"
+        "a  1 \n"
+        "bb 2 \n"
+        "c  3 \n");
+
+    table_print_set_cell (tp, 1, 2, "three");
+    table_print_delete_row (tp, 2);
+    table_print_insert_row (tp, 0);
+    table_print_set_cell (tp, 0, 0, "new");
+    table_print_print (tp);
+    check_output ("delete and insert row", f,
+        "c0  c1\n"
+        "new   \n"
+        "a   1 \n"
+        "bb  2 \n");
+    table_print_free (tp);
+}
+
+static void set_cell_past_ring (FILE *f)
+{
+    struct table_print_t *tp;
+
+    tp = create_table (f, 1);
+    table_print_set_ring (tp, 2);
+    table_print_data_add_str (tp, 0, "a");
+    table_print_data_add_str (tp, 0, "b");
+    table_print_set_cell (tp, 0, 5, "z");
+}
+
+static void set_cell_end_of_ring (FILE *f)
+{
+    struct table_print_t *tp;
+
+    tp = create_table (f, 1);
+    table_print_set_ring (tp, 2);
+    table_print_data_add_str (tp, 0, "a");
+    table_print_set_cell (tp, 0, 1, "z");
+}
+
+// cells of a ring are edited in place, and no row is added
+static void test_edit_ring (FILE *f)
+{
+    struct table_print_t *tp;
+    int i;
+
+    tp = create_table (f, 1);
+    table_print_set_ring (tp, 2);
+    for (i = 0; i < 3; i++)
+        table_print_data_add_int32 (tp, 0, i);
+    table_print_set_cell (tp, 0, 0, "oldest");
+    table_print_set_cell (tp, 0, 1, "x");
+    table_print_print (tp);
+    check_output ("set cell in a ring", f,
+        "c0    \n"
+        "oldest\n"
+        "x     \n");
+    table_print_set_cell (tp, 0, 0, "1");
+    table_print_print (tp);
+    check_output ("set cell in a ring narrows it", f,
+        "c0\n"
+        "1 \n"
+        "x \n");
+    table_print_free (tp);
+
+    check_fatal ("set cell past the end of a ring", set_cell_past_ring, f);
+    check_fatal ("set cell at the end of a ring", set_cell_end_of_ring, f);
+}
+
+
+// Allocator that counts its blocks, and marks them to catch blocks of another allocator
+struct test_allocator_t
+{
+    int blocks;
+    int total;
+    int foreign;
+};
+
+#define TEST_ALLOCATOR_MAGIC 0x7a11c0de
+
+static void *test_malloc (size_t size, void *ctx)
+{
+    struct test_allocator_t *counts = ctx;
+    long long *block;
+
+    block = malloc (size + 16);
+    if (!block)
+        return NULL;
+    block[0] = TEST_ALLOCATOR_MAGIC;
+    counts->blocks++;
+    counts->total++;
+    return block + 2;
+}
+
+static void *test_realloc (void *ptr, size_t size, void *ctx)
+{
+    struct test_allocator_t *counts = ctx;
+    long long *block = (long long *) ptr - 2;
+
+    if (block[0] != TEST_ALLOCATOR_MAGIC) {
+        counts->foreign++;
+        return NULL;
+    }
+    block = realloc (block, size + 16);
+    return block ? block + 2 : NULL;
+}
+
+static void test_free (void *ptr, void *ctx)
+{
+    struct test_allocator_t *counts = ctx;
+    long long *block = (long long *) ptr - 2;
+
+    if (block[0] != TEST_ALLOCATOR_MAGIC) {
+        counts->foreign++;
+        return;
+    }
+    block[0] = 0;
+    counts->blocks--;
+    free (block);
+}
+
+// everything a table and its logs, scans, snapshots and prints allocate goes through its allocator
+static void test_allocator (FILE *f)
+{
+    struct test_allocator_t counts = { 0, 0, 0 };
+    const struct table_print_allocator_t allocator = { test_malloc, test_realloc, test_free, &counts };
+    const enum table_print_dir_field_t fields[] = { table_print_dir_name, table_print_dir_size };
+    const struct table_print_field_t log_fields[] = { { table_print_type_str, 8 }, { table_print_type_int32, 0 } };
+    const struct table_print_aggregate_t agg = { 0, table_print_agg_count };
+    const int key = 0;
+    struct table_print_snapshot_t *snap;
+    struct table_print_t *tp, *groups, *like;
+    struct table_print_log_t *log;
+    char record[16];
+    char dir[] = "/tmp/test_tprint_XXXXXX";
+    char path[64];
+    FILE *lf;
+    int fd;
+    int i;
+
+    tp = table_print_create_with_allocator (f, TRUE, TRUE, 0, 1, &allocator);
+    table_print_column_add (tp, "name", table_print_align_left, table_print_align_left);
+    table_print_column_add (tp, "n", table_print_align_left, table_print_align_right);
+    table_print_column_set_encoding (tp, 0, table_print_encoding_dict);
+    for (i = 0; i < 300; i++) {
+        table_print_data_add_str (tp, 0, i % 3 ? "a name longer than a cell" : "short");
+        table_print_data_add_int32 (tp, 1, i);
+    }
+    groups = table_print_group_by (tp, &key, 1, &agg, 1);
+    table_print_print (groups);
+    check_output ("allocator", f,
+        " =================================\n"
+        "|name                     |count|\n"
+        " =================================\n"
+        "|short                    |  100|\n"
+        "|a name longer than a cell|  200|\n"
+        " =================================\n");
+    table_print_free (groups);
+
+    lf = tmpfile ();
+    if (lf) {
+        i = counts.total;
+        log = table_print_log_create (lf, tp, log_fields, 2);
+        if (counts.total < i + 3) {
+            fprintf (stderr, "FAIL allocator: log made %d blocks\n", counts.total - i);
+            failures++;
+        }
+        memset (record, 0, sizeof (record));
+        table_print_log_append (log, record);
+        table_print_log_free (log);
+        fclose (lf);
+    }
+
+    like = table_print_create_like (tp);
+    snap = table_print_snapshot_create (like);
+    table_print_data_add_str (table_print_snapshot_begin_row (snap), 0, "row");
+    table_print_snapshot_end_row (snap);
+    table_print_snapshot_print (snap);
+    table_print_snapshot_free (snap);
+    check_output ("allocator snapshot", f,
+        " ========\n"
+        "|name|n|\n"
+        " ========\n"
+        "|row | |\n"
+        " ========\n");
+
+    table_print_clear (tp);
+    if (mkdtemp (dir)) {
+        snprintf (path, sizeof (path), "%s/file", dir);
+        fd = open (path, O_CREAT | O_WRONLY, 0600);
+        if (fd >= 0)
+            close (fd);
+        if (table_print_from_directory (tp, dir, fields, 2, 2) != 1) {
+            fprintf (stderr, "FAIL allocator: cannot scan %s\n", dir);
+            failures++;
+        }
+        unlink (path);
+        rmdir (dir);
+    }
+    table_print_print_async (tp, NULL, NULL);
+    table_print_async_wait ();
+    check_output ("allocator async", f,
+        " ========\n"
+        "|name|n|\n"
+        " ========\n"
+        "|file|0|\n"
+        " ========\n");
+
+    if (counts.blocks || counts.foreign || counts.total < 10) {
+        fprintf (stderr, "FAIL allocator: %d blocks left, %d foreign, %d allocated\n",
+            counts.blocks, counts.foreign, counts.total);
+        failures++;
+    }
+}
+
+
+// timestamps formatted with a pattern cached per day, in UTC and across a DST change
+static void test_time (FILE *f)
+{
+    struct table_print_t *tp;
+    double value;
+
+    setenv ("TZ", "UTC", 1);
+    tzset ();
+    tp = create_table (f, 2);
+    table_print_column_set_time (tp, 0, NULL, table_print_time_seconds);
+    table_print_column_set_time (tp, 1, "%d/%m %I:%M:%S.%3N %p|%N|%s", table_print_time_nanoseconds);
+    table_print_data_add_uint64 (tp, 0, 0);
+    table_print_data_add_uint64 (tp, 1, 1000000000ULL * 86399 + 123456789);
+    table_print_data_add_uint64 (tp, 0, 86399);
+    table_print_data_add_uint64 (tp, 1, 1000000000ULL * 86400 + 5);
+    table_print_data_add_int32 (tp, 0, 1700000000);
+    table_print_data_add_int32 (tp, 1, 0);
+    table_print_print (tp);
+    check_output ("time", f,
+        "c0                  c1                                   \n"
+        "1970-01-01 00:00:00 01/01 11:59:59.123 PM|123456789|86399\n"
+        "1970-01-01 23:59:59 02/01 12:00:00.000 AM|000000005|86400\n"
+        "2023-11-14 22:13:20 01/01 12:00:00.000 AM|000000000|0    \n");
+    if (!table_print_get_number (tp, 0, 2, &value) || value != 1700000000) {
+        fprintf (stderr, "FAIL time: value %f\n", value);
+        failures++;
+    }
+    table_print_set_filter (tp, table_print_filter_number (0, table_print_cmp_lt, 86400));
+    table_print_print (tp);
+    check_output ("time filter", f,
+        "c0                  c1                                   \n"
+        "1970-01-01 00:00:00 01/01 11:59:59.123 PM|123456789|86399\n"
+        "1970-01-01 23:59:59 02/01 12:00:00.000 AM|000000005|86400\n");
+    table_print_free (tp);
+
+    // clocks go back from 02:59:59 to 02:00:00 on 2023-10-29, no tzdata needed
+    setenv ("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+    tzset ();
+    tp = create_table (f, 1);
+    table_print_column_set_time (tp, 0, "%H:%M:%S %Z", table_print_time_seconds);
+    table_print_data_add_uint64 (tp, 0, 1698541199);
+    table_print_data_add_uint64 (tp, 0, 1698541200);
+    table_print_data_add_uint64 (tp, 0, 1698544800);
+    table_print_print (tp);
+    check_output ("time dst", f,
+        "c0           \n"
+        "02:59:59 CEST\n"
+        "02:00:00 CET \n"
+        "03:00:00 CET \n");
+    table_print_free (tp);
+    unsetenv ("TZ");
+    tzset ();
+}
+
+
+// a row per entry of a directory, sorted by name and looked up without following links
+static void test_from_directory (FILE *f)
+{
+    static const enum table_print_dir_field_t fields[] = {
+        table_print_dir_name, table_print_dir_mode, table_print_dir_size, table_print_dir_mtime,
+    };
+    static const enum table_print_dir_field_t uid_fields[] = {table_print_dir_name, table_print_dir_uid};
+    struct timespec times[2] = {{86399, 0}, {86399, 0}};
+    char dir[] = "/tmp/test_tprint_XXXXXX";
+    char path[64];
+    struct table_print_t *tp;
+    double value;
+    FILE *out;
+    int i, n;
+
+    if (!mkdtemp (dir)) {
+        perror ("mkdtemp");
+        failures++;
+        return;
+    }
+    snprintf (path, sizeof (path), "%s/b", dir);
+    out = fopen (path, "w");
+    fputs ("0123456789", out);
+    fclose (out);
+    chmod (path, 0640);
+    utimensat (AT_FDCWD, path, times, 0);
+    snprintf (path, sizeof (path), "%s/a", dir);
+    close (open (path, O_CREAT | O_WRONLY, 0600));
+    chmod (path, 0600);
+    utimensat (AT_FDCWD, path, times, 0);
+    snprintf (path, sizeof (path), "%s/c", dir);
+    mkfifo (path, 0600);
+    chmod (path, 0604);
+    utimensat (AT_FDCWD, path, times, 0);
+    snprintf (path, sizeof (path), "%s/d", dir);
+    symlink ("b", path);
+    utimensat (AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW);
+
+    setenv ("TZ", "UTC", 1);
+    tzset ();
+    tp = create_table (f, 4);
+    table_print_column_set_time (tp, 3, NULL, table_print_time_seconds);
+    n = table_print_from_directory (tp, dir, fields, 4, 1);
+    if (n != 4) {
+        fprintf (stderr, "FAIL from_directory: %d rows\n", n);
+        failures++;
+    }
+    table_print_print (tp);
+    check_output ("from_directory", f,
+        "c0 c1         c2 c3                 \n"
+        "a  -rw------- 0  1970-01-01 23:59:59\n"
+        "b  -rw-r----- 10 1970-01-01 23:59:59\n"
+        "c  prw----r-- 0  1970-01-01 23:59:59\n"
+        "d  lrwxrwxrwx 1  1970-01-01 23:59:59\n");
+    table_print_free (tp);
+    tp = create_table (f, 2);
+    table_print_from_directory (tp, dir, uid_fields, 2, 1);
+    if (!table_print_get_number (tp, 1, 1, &value) || value != getuid ()) {
+        fprintf (stderr, "FAIL from_directory uid: %f\n", value);
+        failures++;
+    }
+    table_print_free (tp);
+    unsetenv ("TZ");
+    tzset ();
+
+    // names only need no lookups; several workers share the lookups of many entries
+    for (i = 0; i < 300; i++) {
+        snprintf (path, sizeof (path), "%s/f%03d", dir, 299 - i);
+        close (open (path, O_CREAT | O_WRONLY, 0600));
+    }
+    tp = create_table (f, 1);
+    n = table_print_from_directory (tp, dir, fields, 1, 1);
+    check_cell ("from_directory names", tp, 0, 4, "f000");
+    check_cell ("from_directory names", tp, 0, 303, "f299");
+    table_print_free (tp);
+    if (n != 304) {
+        fprintf (stderr, "FAIL from_directory names: %d rows\n", n);
+        failures++;
+    }
+    tp = create_table (f, 3);
+    n = table_print_from_directory (tp, dir, fields, 3, 4);
+    check_cell ("from_directory workers", tp, 0, 3, "d");
+    check_cell ("from_directory workers", tp, 1, 3, "lrwxrwxrwx");
+    check_cell ("from_directory workers", tp, 0, 303, "f299");
+    check_cell ("from_directory workers", tp, 1, 303, "-rw-------");
+    check_cell ("from_directory workers", tp, 2, 303, "0");
+    table_print_free (tp);
+    if (n != 304) {
+        fprintf (stderr, "FAIL from_directory workers: %d rows\n", n);
+        failures++;
+    }
+
+    for (i = 0; i < 300; i++) {
+        snprintf (path, sizeof (path), "%s/f%03d", dir, i);
+        unlink (path);
+    }
+    snprintf (path, sizeof (path), "%s/a", dir);
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/b", dir);
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/c", dir);
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/d", dir);
+    unlink (path);
+    rmdir (dir);
+
+    tp = create_table (f, 1);
+    errno = 0;
+    n = table_print_from_directory (tp, dir, fields, 1, 1);
+    if (n != -1 || errno != ENOENT) {
+        fprintf (stderr, "FAIL from_directory missing: %d, errno %d\n", n, errno);
+        failures++;
+    }
+    table_print_free (tp);
+}
+
+
+static void dict_encoding_after_data (FILE *f)
+{
+    struct table_print_t *tp = create_table (f, 1);
+
+    table_print_data_add_str (tp, 0, "a");
+    table_print_column_set_encoding (tp, 0, table_print_encoding_dict);
+}
+
+// distinct values stored once, codes spanning blocks, rehashes and overwritten rows
+static void test_dict (FILE *f)
+{
+    struct table_print_t *tp;
+    char buf[16];
+    int i;
+
+    tp = create_table (f, 2);
+    table_print_column_set_encoding (tp, 0, table_print_encoding_dict);
+    table_print_column_set_encoding (tp, 1, table_print_encoding_dict);
+    table_print_data_add_str (tp, 0, "ab");
+    table_print_data_add_str (tp, 0, "abc");
+    table_print_data_add_str (tp, 0, "");
+    table_print_data_add_str (tp, 0, "ab");
+    table_print_data_add_int32 (tp, 1, 7);
+    table_print_data_add_str (tp, 1, "7");
+    table_print_data_add_double (tp, 1, 0.5);
+    table_print_data_add_str (tp, 1, "x y");
+    table_print_print (tp);
+    check_output ("dict", f,
+        "c0  c1   \n"
+        "ab  7    \n"
+        "abc 7    \n"
+        "    0.500\n"
+        "ab  x y  \n");
+    table_print_set_cell (tp, 0, 1, "ab");
+    table_print_set_cell (tp, 0, 3, "new");
+    check_cell ("dict set", tp, 0, 0, "ab");
+    check_cell ("dict set", tp, 0, 1, "ab");
+    check_cell ("dict set", tp, 0, 2, "");
+    check_cell ("dict set", tp, 0, 3, "new");
+    table_print_free (tp);
+
+    // 1000 distinct values repeated over 3000 rows, more than a block of codes
+    tp = create_table (f, 1);
+    table_print_column_set_encoding (tp, 0, table_print_encoding_dict);
+    for (i = 0; i < 3000; i++) {
+        snprintf (buf, sizeof (buf), "v%d", i % 1000);
+        table_print_data_add_str (tp, 0, buf);
+    }
+    check_cell ("dict many", tp, 0, 0, "v0");
+    check_cell ("dict many", tp, 0, 999, "v999");
+    check_cell ("dict many", tp, 0, 1256, "v256");
+    check_cell ("dict many", tp, 0, 2999, "v999");
+    table_print_free (tp);
+
+    check_fatal ("dict encoding after data", dict_encoding_after_data, f);
+}
+
 
 int main()
 {
     struct table_print_t *tp;
+    FILE *f;
     double d1 = 40.488, d2 = 112.908 , d3 = 3.23;
     int i1 = 532, i2 = 3;
     int i;
@@ -64,5 +1585,37 @@ int main()
     table_print_print(tp);
     table_print_free(tp);
 
-    return 0;
+    f = tmpfile ();
+    if (!f) {
+        perror ("tmpfile");
+        return 1;
+    }
+    test_inline_cells (f);
+    test_render_plan (f);
+    test_max_width (f);
+    test_spill (f);
+    test_delta (f);
+    test_async (f);
+    test_snapshot_print (f);
+    test_view (f);
+    test_filter (f);
+    test_group_by (f);
+    test_list ();
+    test_borrowed (f);
+    test_log (f);
+    test_tprint_tool ();
+    test_ring (f);
+    test_merge (f);
+    test_save (f);
+    test_save_spilled (f);
+    test_virtual (f);
+    test_edit (f);
+    test_edit_ring (f);
+    test_allocator (f);
+    test_time (f);
+    test_from_directory (f);
+    test_dict (f);
+    fclose (f);
+
+    return failures ? 1 : 0;
 }
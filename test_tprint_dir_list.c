@@ -18,89 +18,43 @@
 
 // Example how to use libtprint to display directory listing
 
-#include "tprint.h"
-#include <sys/types.h>
-#include <dirent.h>
-#include <sys/stat.h>
-#include <unistd.h>
+#include "table-print.h"
+#include <errno.h>
 #include <string.h>
-#include <time.h>
-
-const gchar *get_perm_str (mode_t st_mode)
-{
-    static gchar out[11];
-
-    out[0] = (S_ISDIR (st_mode)) ? 'd' : '-';
-    out[1] = (st_mode & S_IRUSR) ? 'r' : '-';
-    out[2] = (st_mode & S_IWUSR) ? 'w' : '-';
-    out[3] = (st_mode & S_IXUSR) ? 'x' : '-';
-    out[4] = (st_mode & S_IRGRP) ? 'r' : '-';
-    out[5] = (st_mode & S_IWGRP) ? 'w' : '-';
-    out[6] = (st_mode & S_IXGRP) ? 'x' : '-';
-    out[7] = (st_mode & S_IROTH) ? 'r' : '-';
-    out[8] = (st_mode & S_IWOTH) ? 'w' : '-';
-    out[9] = (st_mode & S_IXOTH) ? 'x' : '-';
-
-    out[10] = '\0';
-
-    return out;
-}
-
-const gchar *time_to_str (time_t t)
-{
-    struct tm *tmp;
-    static gchar out[50];
-
-    tmp = localtime (&t);
-    strftime (out, sizeof (out), "%b %d %H:%M", tmp);
-
-    return out;
-}
 
 int main (int argc, char *argv[])
 {
-    DIR *dir;
-	struct dirent *ent;
-    TPrint *tp;
-    gchar path[1024];
-    gchar dir_name[1024];
-
-    tp = tprint_create (stdout, FALSE, FALSE, 0, 2);
-
-    tprint_column_add (tp, "Permissions", TPAlign_center, TPAlign_left);
-    tprint_column_add (tp, "Owner", TPAlign_center, TPAlign_left);
-    tprint_column_add (tp, "Size", TPAlign_center, TPAlign_right);
-    tprint_column_add (tp, "Time", TPAlign_center, TPAlign_left);
-    tprint_column_add (tp, "Name", TPAlign_center, TPAlign_left);
-
-    strncpy (dir_name, argc > 1 ? argv[1] : ".", sizeof (dir_name));
-    dir = opendir (dir_name);
-    if (!dir) {
-        g_fprintf (stderr, "Failed to open directory %s for reading !", dir_name);
+    const enum table_print_dir_field_t fields[] = {
+        table_print_dir_mode, table_print_dir_uid, table_print_dir_size,
+        table_print_dir_mtime, table_print_dir_name,
+    };
+    struct table_print_t *tp;
+    const char *dir_name = argc > 1 ? argv[1] : ".";
+
+    tp = table_print_create (stdout, FALSE, FALSE, 0, 2);
+
+    table_print_column_add (tp, "Permissions", table_print_align_center, table_print_align_left);
+    table_print_column_add (tp, "Owner", table_print_align_center, table_print_align_left);
+    table_print_column_add (tp, "Size", table_print_align_center, table_print_align_right);
+    table_print_column_add (tp, "Time", table_print_align_center, table_print_align_left);
+    table_print_column_add (tp, "Name", table_print_align_center, table_print_align_left);
+
+    // only a handful of distinct permissions and owners in a directory
+    table_print_column_set_encoding (tp, 0, table_print_encoding_dict);
+    table_print_column_set_encoding (tp, 1, table_print_encoding_dict);
+
+    // modification times are kept as numbers and formatted when printed
+    table_print_column_set_time (tp, 3, "%b %d %H:%M", table_print_time_seconds);
+
+    // entries are looked up by a thread per CPU, and sorted by name
+    if (table_print_from_directory (tp, dir_name, fields, 5, 0) < 0) {
+        fprintf (stderr, "Failed to open directory %s for reading: %s\n", dir_name, strerror (errno));
+        table_print_free (tp);
         return 1;
     }
 
-    while ((ent = readdir (dir)) != NULL) {
-        struct stat stbuf;
-
-        g_snprintf (path, sizeof (path), "%s/%s", dir_name, ent->d_name);
-
-        if (lstat (path, &stbuf)) {
-            g_fprintf (stderr, "Failed to open %s for reading !", path);
-            continue;
-        }
-
-        tprint_data_add_str (tp, 0, get_perm_str (stbuf.st_mode));
-        tprint_data_add_int32 (tp, 1, stbuf.st_uid);
-        tprint_data_add_uint64 (tp, 2, stbuf.st_size);
-        tprint_data_add_str (tp, 3, time_to_str (stbuf.st_mtime));
-        tprint_data_add_str (tp, 4, ent->d_name);
-    }
-
-    closedir (dir);
-
-    tprint_print (tp);
-    tprint_free (tp);
+    table_print_print (tp);
+    table_print_free (tp);
 
     return 0;
 }
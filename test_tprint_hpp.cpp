@@ -0,0 +1,65 @@
+/*
+ * Table Print utilities
+ * Copyright (C) 2012-2013 Paul Ionkin <paul.ionkin@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+// Example how to use the C++ wrapper of libtprint
+
+#include "table-print.hpp"
+
+// Values that add_row() takes, and the ones that do not compile
+static_assert(tprint::detail::converts<int, short>::value, "short fits in int");
+static_assert(tprint::detail::converts<int, unsigned short>::value, "unsigned short fits in int");
+static_assert(tprint::detail::converts<unsigned long long, unsigned>::value, "unsigned fits in uint64");
+static_assert(!tprint::detail::converts<unsigned long long, int>::value, "-1 would wrap around");
+static_assert(!tprint::detail::converts<unsigned long long, long long>::value, "signed into unsigned");
+static_assert(!tprint::detail::converts<int, unsigned>::value, "large unsigned would turn negative");
+static_assert(!tprint::detail::converts<int, long long>::value, "narrowing");
+static_assert(!tprint::detail::converts<int, bool>::value, "bool is not a number");
+static_assert(!tprint::detail::converts<int, double>::value, "narrowing");
+static_assert(tprint::detail::converts<double, int>::value, "int fits in a double");
+static_assert(tprint::detail::converts<double, unsigned>::value, "unsigned fits in a double");
+static_assert(tprint::detail::converts<double, float>::value, "float fits in a double");
+static_assert(!tprint::detail::converts<double, long long>::value, "64 bit integers lose digits");
+static_assert(!tprint::detail::converts<double, unsigned long long>::value, "64 bit integers lose digits");
+static_assert(!tprint::detail::converts<double, long double>::value, "narrowing");
+static_assert(!tprint::detail::converts<double, bool>::value, "bool is not a number");
+static_assert(tprint::detail::converts<const char *, std::string>::value, "strings");
+static_assert(!tprint::detail::converts<const char *, int>::value, "numbers are not strings");
+
+int main()
+{
+    tprint::table<tprint::column<const char *>,
+                  tprint::column<unsigned long long, tprint::align::right>,
+                  tprint::column<int, tprint::align::right>,
+                  tprint::column<double, tprint::align::right> > t(stdout, {"Name", "Bytes", "Delta", "Load"});
+
+    t.add_row("host1", 1024ULL, -3, 0.75);
+    t.add_row(std::string("host2"), 65536U, 12, 1.5);
+    // t.add_row("host3", -1, 0, 0.0); does not compile: -1 is signed
+    t.print();
+
+    typedef tprint::layout<tprint::border::ascii, 0, 2,
+                           tprint::field<12>,
+                           tprint::field<8, tprint::align::right>,
+                           tprint::field<10, tprint::align::right, 2> > stats;
+    stats::print_border(stdout);
+    stats::print_row(stdout, "requests", 1234, 0.98);
+    stats::print_border(stdout);
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Table Print utilities
+ * Copyright (C) 2012-2013 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2013 Vicent Selfa <vtselfa@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* Print the table recorded in a row log (table_print_log_create) */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "table-print.h"
+
+
+int main(int argc, char *argv[])
+{
+	struct table_print_t *tp;
+	FILE *f = stdin;
+
+	if (argc > 2 || (argc == 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))))
+	{
+		fprintf(stderr, "Usage: %s [LOG]\nPrint the table recorded in LOG, or in the standard input.\n", argv[0]);
+		return 1;
+	}
+	if (argc == 2 && strcmp(argv[1], "-"))
+	{
+		f = fopen(argv[1], "rb");
+		if (!f)
+		{
+			perror(argv[1]);
+			return 1;
+		}
+	}
+
+	tp = table_print_log_read(f, stdout);
+	if (f != stdin)
+		fclose(f);
+	if (!tp)
+		return 1;
+
+	table_print_print(tp);
+	table_print_free(tp);
+	return 0;
+}
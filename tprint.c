@@ -0,0 +1,426 @@
+/*
+ * Table Print utilities
+ * Copyright (C) 2012-2013 Paul Ionkin <paul.ionkin@gmail.com>
+ * Copyright (C) 2013 Vicent Selfa <vtselfa@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/* Print delimited text (TSV, CSV without quoting...) as a table.
+ *
+ * Regular files are mapped in memory and loaded whole, so column widths are
+ * exact. Other inputs, or any input with -S, are streamed: every ROWS lines
+ * are printed as a table of their own. Cells are borrowed from the mapping or
+ * the read buffer, never copied. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "table-print.h"
+
+
+/* Initial size of the streaming buffer */
+#define TPRINT_BUFFER (1024 * 1024)
+
+/* Rows per table when streaming and -S is not given */
+#define TPRINT_STREAM_ROWS 1000
+
+/* Cells are handed to the table this many rows at a time */
+#define TPRINT_BATCH 256
+
+
+/* Cells of a column waiting to be added */
+struct tprint_column_t
+{
+	const char *str[TPRINT_BATCH];
+	int len[TPRINT_BATCH];
+};
+
+
+struct tprint_t
+{
+	struct table_print_t *tp;
+	int num_columns;
+	int rows;
+
+	struct tprint_column_t *columns;
+	int batch; // rows in 'columns'
+
+	char delim;
+	const char *aligns; // one of l, c, r per column, the last one repeats
+	int header; // the first line holds the captions
+	int max_width;
+};
+
+
+static void tprint_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [OPTIONS] [FILE]\n"
+		"Print the delimited text in FILE, or in the standard input, as a table.\n"
+		"\n"
+		"  -d DELIM   field delimiter (default: tab)\n"
+		"  -H         the first line holds the column captions\n"
+		"  -a ALIGNS  alignment of each column: l, c or r. The last one repeats (default: l)\n"
+		"  -b         draw borders\n"
+		"  -l N       spaces on the left of the table (default: 0)\n"
+		"  -g N       spaces between columns (default: 2)\n"
+		"  -w N       cut cells wider than N characters\n"
+		"  -S ROWS    stream the input, printing a table every ROWS lines\n",
+		prog);
+}
+
+
+static enum table_print_align_t tprint_align(struct tprint_t *t, int col)
+{
+	int len = t->aligns ? strlen(t->aligns) : 0;
+	char c;
+
+	if (!len)
+		return table_print_align_left;
+	c = t->aligns[col < len ? col : len - 1];
+	if (c == 'r')
+		return table_print_align_right;
+	if (c == 'c')
+		return table_print_align_center;
+	return table_print_align_left;
+}
+
+
+static void tprint_out_of_memory(void)
+{
+	perror("tprint");
+	exit(1);
+}
+
+
+/* Add the batched cells to the table */
+static void tprint_flush(struct tprint_t *t)
+{
+	int i;
+
+	for (i = 0; i < t->num_columns; i++)
+		table_print_data_add_str_ref_array(t->tp, i, t->columns[i].str, t->columns[i].len, t->batch);
+	t->batch = 0;
+}
+
+
+/* Add a column, with empty cells for the rows already loaded */
+static void tprint_add_column(struct tprint_t *t, const char *caption, int len)
+{
+	enum table_print_align_t align = tprint_align(t, t->num_columns);
+	struct tprint_column_t *col;
+	char *copy;
+	int i;
+
+	copy = malloc(len + 1);
+	if (!copy)
+		tprint_out_of_memory();
+	memcpy(copy, caption, len);
+	copy[len] = '\0';
+	table_print_column_add(t->tp, copy, align, align);
+	if (t->max_width)
+		table_print_column_set_max_width(t->tp, t->num_columns, t->max_width, table_print_overflow_ellipsis);
+	free(copy);
+
+	t->columns = realloc(t->columns, (t->num_columns + 1) * sizeof(struct tprint_column_t));
+	if (!t->columns)
+		tprint_out_of_memory();
+	col = &t->columns[t->num_columns];
+	for (i = 0; i < t->rows - t->batch; i++)
+		table_print_data_add_str_ref(t->tp, t->num_columns, "", 0);
+	for (i = 0; i < t->batch; i++)
+	{
+		col->str[i] = "";
+		col->len[i] = 0;
+	}
+	t->num_columns++;
+}
+
+
+/* Split a line into cells, or into captions if the header is still missing.
+ * memchr does the scanning, with the vector instructions of the C library. */
+static void tprint_add_line(struct tprint_t *t, const char *line, int len)
+{
+	const char *end = line + len;
+	const char *p = line;
+	int col = 0;
+
+	if (len && line[len - 1] == '\r')
+		end--;
+
+	for (;;)
+	{
+		const char *q = memchr(p, t->delim, end - p);
+		int field_len = (q ? q : end) - p;
+
+		if (t->header)
+			tprint_add_column(t, p, field_len);
+		else
+		{
+			if (col >= t->num_columns)
+				tprint_add_column(t, "", 0);
+			t->columns[col].str[t->batch] = p;
+			t->columns[col].len[t->batch] = field_len;
+		}
+		col++;
+
+		if (!q)
+			break;
+		p = q + 1;
+	}
+
+	if (t->header)
+	{
+		t->header = FALSE;
+		return;
+	}
+	for (; col < t->num_columns; col++)
+	{
+		t->columns[col].str[t->batch] = "";
+		t->columns[col].len[t->batch] = 0;
+	}
+	t->rows++;
+	if (++t->batch == TPRINT_BATCH)
+		tprint_flush(t);
+}
+
+
+/* Load up to 'max_lines' lines of 'buf'. A last line without newline is only
+ * loaded if 'eof'. Returns the number of bytes loaded. */
+static size_t tprint_load(struct tprint_t *t, const char *buf, size_t len, int max_lines, int eof)
+{
+	const char *p = buf;
+	const char *end = buf + len;
+	int lines;
+
+	for (lines = 0; p < end && lines < max_lines; lines++)
+	{
+		const char *nl = memchr(p, '\n', end - p);
+
+		if (!nl)
+		{
+			if (!eof)
+				break;
+			nl = end;
+		}
+		tprint_add_line(t, p, nl - p);
+		p = nl < end ? nl + 1 : end;
+	}
+	return p - buf;
+}
+
+
+static void tprint_print(struct tprint_t *t)
+{
+	tprint_flush(t);
+	if (t->rows || t->num_columns)
+		table_print_print(t->tp);
+	table_print_clear(t->tp);
+	t->rows = 0;
+}
+
+
+/* Whole file at once */
+static int tprint_map(struct tprint_t *t, int fd, size_t size)
+{
+	char *map;
+
+	if (!size)
+		return 0;
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return -1;
+	madvise(map, size, MADV_SEQUENTIAL);
+
+	tprint_load(t, map, size, -1U >> 1, TRUE);
+	tprint_print(t);
+
+	munmap(map, size);
+	return 0;
+}
+
+
+/* A table every 'rows' lines */
+static int tprint_stream(struct tprint_t *t, int fd, int rows)
+{
+	size_t size = TPRINT_BUFFER;
+	size_t len = 0;
+	size_t scanned = 0;
+	size_t used;
+	int lines = 0;
+	int eof = FALSE;
+	char *buf;
+
+	buf = malloc(size);
+	if (!buf)
+		return -1;
+
+	for (;;)
+	{
+		/* Complete lines read so far */
+		for (;;)
+		{
+			char *nl = memchr(buf + scanned, '\n', len - scanned);
+
+			if (!nl)
+			{
+				scanned = len;
+				break;
+			}
+			scanned = nl - buf + 1;
+			lines++;
+		}
+
+		/* Read until there are enough for a table */
+		if (!eof && lines < rows + t->header)
+		{
+			ssize_t n;
+
+			if (len == size)
+			{
+				char *bigger = realloc(buf, size * 2);
+
+				if (!bigger)
+				{
+					free(buf);
+					return -1;
+				}
+				buf = bigger;
+				size *= 2;
+			}
+			n = read(fd, buf + len, size - len);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+			{
+				free(buf);
+				return -1;
+			}
+			if (!n)
+				eof = TRUE;
+			len += n;
+			continue;
+		}
+		if (!len)
+			break;
+
+		/* Cells point into 'buf', which does not change until they are printed */
+		used = tprint_load(t, buf, len, rows + t->header, eof);
+		tprint_print(t);
+		memmove(buf, buf + used, len - used);
+		len -= used;
+		scanned = 0;
+		lines = 0;
+	}
+
+	free(buf);
+	return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct tprint_t t;
+	struct stat st;
+	int show_borders = FALSE;
+	int spaces_left = 0;
+	int spaces_between = 2;
+	int stream_rows = 0;
+	int fd = 0;
+	int err;
+	int opt;
+
+	memset(&t, 0, sizeof(t));
+	t.delim = '\t';
+	while ((opt = getopt(argc, argv, "d:Ha:bl:g:w:S:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			t.delim = optarg[0];
+			break;
+		case 'H':
+			t.header = TRUE;
+			break;
+		case 'a':
+			t.aligns = optarg;
+			break;
+		case 'b':
+			show_borders = TRUE;
+			break;
+		case 'l':
+			spaces_left = atoi(optarg);
+			break;
+		case 'g':
+			spaces_between = atoi(optarg);
+			break;
+		case 'w':
+			t.max_width = atoi(optarg);
+			break;
+		case 'S':
+			stream_rows = atoi(optarg);
+			if (stream_rows <= 0)
+			{
+				tprint_usage(argv[0]);
+				return 1;
+			}
+			break;
+		default:
+			tprint_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc - 1)
+	{
+		tprint_usage(argv[0]);
+		return 1;
+	}
+	if (optind == argc - 1 && strcmp(argv[optind], "-"))
+	{
+		fd = open(argv[optind], O_RDONLY);
+		if (fd < 0)
+		{
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	/* Rows are written with one fwrite each */
+	setvbuf(stdout, NULL, _IOFBF, 1024 * 1024);
+	t.tp = table_print_create(stdout, show_borders, t.header, spaces_left, spaces_between);
+
+	if (!stream_rows && !fstat(fd, &st) && S_ISREG(st.st_mode))
+	{
+		err = tprint_map(&t, fd, st.st_size);
+		if (err && errno == ENODEV)
+			err = tprint_stream(&t, fd, TPRINT_STREAM_ROWS);
+	}
+	else
+		err = tprint_stream(&t, fd, stream_rows ? stream_rows : TPRINT_STREAM_ROWS);
+	if (err)
+		perror(optind < argc ? argv[optind] : "stdin");
+
+	table_print_free(t.tp);
+	free(t.columns);
+	if (fd)
+		close(fd);
+	fflush(stdout);
+	return err ? 1 : 0;
+}